@@ -0,0 +1,554 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+/* Smallest whole disc cache worth having when memory is short */
+#define MIN_CACHE_DISC_MEM (1024*1024)
+
+/* Packed blocks may be read this far past their end */
+#define PACK_SLACK 4
+
+struct CDDACache *alloc_cdda_cache(struct PlayCDDAData *pcd) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	struct CDDACache          *cache;
+	ULONG                      size;
+
+	if (pcpd->pcpd_CacheDisc)
+		size = pcpd->pcpd_CacheDiscMem;
+	else if (pcpd->pcpd_InstantStart > 0)
+		size = pcpd->pcpd_InstantStartMem;
+	else
+		return NULL;
+
+	size -= size % CDDA_FRAME_SIZE;
+	if (size == 0)
+		return NULL;
+
+	cache = alloc_shared_mem(sizeof(*cache));
+	if (cache == NULL)
+		return NULL;
+
+	memset(cache, 0, sizeof(*cache));
+
+	cache->cc_WholeDisc = pcpd->pcpd_CacheDisc;
+	cache->cc_Packed    = pcpd->pcpd_CachePacked;
+
+	if (pcpd->pcpd_InstantStart > 0) {
+		cache->cc_IntroFrames = pcpd->pcpd_InstantStart * CDDA_FRAMES_PER_SEC;
+
+		/* Whole blocks, so that the rest of the track can follow on */
+		if (cache->cc_Packed)
+			cache->cc_IntroFrames += (CACHE_BLOCK_FRAMES - 1) - ((cache->cc_IntroFrames - 1) % CACHE_BLOCK_FRAMES);
+	}
+
+	/* Settle for caching part of the disc if the budget isn't available */
+	while ((cache->cc_Mem = alloc_shared_mem(size + PACK_SLACK)) == NULL) {
+		if (!cache->cc_WholeDisc || size <= MIN_CACHE_DISC_MEM) {
+			free_cdda_cache(cache);
+			return NULL;
+		}
+
+		size /= 2;
+		size -= size % CDDA_FRAME_SIZE;
+	}
+
+	cache->cc_MemSize = size;
+
+	return cache;
+}
+
+void free_cdda_cache(struct CDDACache *cache) {
+	if (cache != NULL) {
+		if (cache->cc_Mem != NULL)
+			free_shared_mem(cache->cc_Mem, cache->cc_MemSize + PACK_SLACK);
+
+		free_shared_mem(cache, sizeof(*cache));
+	}
+}
+
+/* Packed blocks are one byte for the method followed by either the raw
+ * block or, for PACK_RICE, one byte per channel with the predictor order
+ * and Rice parameter, and then the Rice coded residuals of mid and side
+ * interleaved sample by sample. The predictors start from zero in every
+ * block, so each one can be unpacked on its own. */
+enum {
+	PACK_RAW,
+	PACK_RICE
+};
+
+#define RICE_ESCAPE    24 /* Quotient that is followed by the value verbatim */
+#define RICE_RAW_BITS  20
+#define RICE_MAX_PARAM 19
+
+struct BitWriter {
+	UBYTE *bw_Ptr;
+	UBYTE *bw_End;
+	ULONG  bw_Acc;
+	int    bw_Bits;
+};
+
+/* Up to 24 bits at a time. Returns FALSE once the output is full. */
+static inline BOOL put_bits(struct BitWriter *bw, ULONG value, int bits) {
+	bw->bw_Acc   = (bw->bw_Acc << bits) | value;
+	bw->bw_Bits += bits;
+
+	while (bw->bw_Bits >= 8) {
+		if (bw->bw_Ptr == bw->bw_End)
+			return FALSE;
+
+		bw->bw_Bits -= 8;
+		*bw->bw_Ptr++ = bw->bw_Acc >> bw->bw_Bits;
+	}
+
+	return TRUE;
+}
+
+static inline BOOL put_rice(struct BitWriter *bw, ULONG value, int k) {
+	ULONG q = value >> k;
+
+	if (q >= RICE_ESCAPE)
+		return put_bits(bw, (1UL << RICE_ESCAPE) - 1, RICE_ESCAPE) && put_bits(bw, value, RICE_RAW_BITS);
+
+	/* q ones and a terminating zero */
+	return put_bits(bw, ((1UL << q) - 1) << 1, q + 1) && put_bits(bw, value & ((1UL << k) - 1), k);
+}
+
+struct BitReader {
+	const UBYTE *br_Ptr;
+	ULONG        br_Acc;
+	int          br_Bits;
+};
+
+static inline ULONG get_bits(struct BitReader *br, int bits) {
+	while (br->br_Bits < bits) {
+		br->br_Acc   = (br->br_Acc << 8) | *br->br_Ptr++;
+		br->br_Bits += 8;
+	}
+
+	br->br_Bits -= bits;
+
+	return (br->br_Acc >> br->br_Bits) & ((1UL << bits) - 1);
+}
+
+static inline ULONG get_rice(struct BitReader *br, int k) {
+	ULONG q = 0;
+
+	while (get_bits(br, 1)) {
+		if (++q == RICE_ESCAPE)
+			return get_bits(br, RICE_RAW_BITS);
+	}
+
+	return (q << k) | get_bits(br, k);
+}
+
+/* Signed residuals to unsigned, small magnitudes first */
+static inline ULONG zigzag(LONG e) {
+	return ((ULONG)e << 1) ^ (ULONG)(e >> 31);
+}
+
+static inline LONG unzigzag(ULONG u) {
+	return (LONG)(u >> 1) ^ -(LONG)(u & 1);
+}
+
+static inline LONG predict(int order, LONG x1, LONG x2) {
+	switch (order) {
+		case 0:  return 0;
+		case 1:  return x1;
+		default: return 2 * x1 - x2;
+	}
+}
+
+/* Stereo decorrelation, undone exactly by unpack_block() */
+#define MID(l, r)  (((l) + (r)) >> 1)
+#define SIDE(l, r) ((l) - (r))
+
+#define SAMPLE(p) ((LONG)(WORD)((p)[0] | ((p)[1] << 8)))
+
+/* Packs frames of CDDA from src into dst. Returns the packed size, or 0 if
+ * it won't fit in size bytes. */
+static ULONG pack_block(const UBYTE *src, int frames, UBYTE *dst, ULONG size) {
+	struct BitWriter bw;
+	const UBYTE     *p;
+	ULONG            sum[2][3];
+	LONG             x[2], x1[2], x2[2];
+	LONG             l, r;
+	ULONG            n = frames * (CDDA_FRAME_SIZE / 4);
+	ULONG            best;
+	int              order[2], k[2];
+	int              i, c, o;
+
+	if (size < 1 + frames * CDDA_FRAME_SIZE)
+		return 0;
+
+	/* Pick the predictor order and Rice parameter for each channel */
+	memset(sum, 0, sizeof(sum));
+	x1[0] = x1[1] = x2[0] = x2[1] = 0;
+
+	for (i = 0, p = src; i < n; i++, p += 4) {
+		l = SAMPLE(p);
+		r = SAMPLE(p + 2);
+
+		x[0] = MID(l, r);
+		x[1] = SIDE(l, r);
+
+		for (c = 0; c < 2; c++) {
+			for (o = 0; o < 3; o++)
+				sum[c][o] += zigzag(x[c] - predict(o, x1[c], x2[c]));
+
+			x2[c] = x1[c];
+			x1[c] = x[c];
+		}
+	}
+
+	for (c = 0; c < 2; c++) {
+		order[c] = 0;
+		for (o = 1; o < 3; o++) {
+			if (sum[c][o] < sum[c][order[c]])
+				order[c] = o;
+		}
+
+		best = sum[c][order[c]];
+		for (k[c] = 0; k[c] < RICE_MAX_PARAM && (n << (k[c] + 1)) <= best; k[c]++);
+	}
+
+	bw.bw_Ptr  = dst;
+	bw.bw_End  = dst + frames * CDDA_FRAME_SIZE;
+	bw.bw_Acc  = 0;
+	bw.bw_Bits = 0;
+
+	put_bits(&bw, PACK_RICE, 8);
+	put_bits(&bw, (order[0] << 5) | k[0], 8);
+	put_bits(&bw, (order[1] << 5) | k[1], 8);
+
+	x1[0] = x1[1] = x2[0] = x2[1] = 0;
+
+	for (i = 0, p = src; i < n; i++, p += 4) {
+		l = SAMPLE(p);
+		r = SAMPLE(p + 2);
+
+		x[0] = MID(l, r);
+		x[1] = SIDE(l, r);
+
+		for (c = 0; c < 2; c++) {
+			if (!put_rice(&bw, zigzag(x[c] - predict(order[c], x1[c], x2[c])), k[c]))
+				goto raw;
+
+			x2[c] = x1[c];
+			x1[c] = x[c];
+		}
+	}
+
+	if (bw.bw_Bits > 0 && !put_bits(&bw, 0, 8 - bw.bw_Bits))
+		goto raw;
+
+	return bw.bw_Ptr - dst;
+
+raw:
+	/* Doesn't pack, noise most likely */
+	dst[0] = PACK_RAW;
+	memcpy(dst + 1, src, frames * CDDA_FRAME_SIZE);
+
+	return 1 + frames * CDDA_FRAME_SIZE;
+}
+
+static void unpack_block(const UBYTE *src, int frames, UBYTE *dst) {
+	struct BitReader br;
+	LONG             x[2], x1[2], x2[2];
+	LONG             m, l, r;
+	ULONG            n = frames * (CDDA_FRAME_SIZE / 4);
+	int              order[2], k[2];
+	int              i, c;
+
+	if (src[0] == PACK_RAW) {
+		memcpy(dst, src + 1, frames * CDDA_FRAME_SIZE);
+		return;
+	}
+
+	for (c = 0; c < 2; c++) {
+		order[c] = src[1 + c] >> 5;
+		k[c]     = src[1 + c] & 0x1F;
+	}
+
+	br.br_Ptr  = src + 3;
+	br.br_Acc  = 0;
+	br.br_Bits = 0;
+
+	x1[0] = x1[1] = x2[0] = x2[1] = 0;
+
+	for (i = 0; i < n; i++, dst += 4) {
+		for (c = 0; c < 2; c++) {
+			x[c] = predict(order[c], x1[c], x2[c]) + unzigzag(get_rice(&br, k[c]));
+
+			x2[c] = x1[c];
+			x1[c] = x[c];
+		}
+
+		/* The bit lost from the mid channel is the low bit of the side */
+		m = ((ULONG)x[0] << 1) | (x[1] & 1);
+		l = (m + x[1]) >> 1;
+		r = (m - x[1]) >> 1;
+
+		dst[0] = l;
+		dst[1] = l >> 8;
+		dst[2] = r;
+		dst[3] = r >> 8;
+	}
+}
+
+/* Give every audio track an extent at its start. Each one gets up to
+ * cc_IntroFrames first, so that as many tracks as possible can start
+ * instantly. In whole disc mode what's left then goes to the tracks in
+ * order, until the memory runs out. When packing, the plan assumes a
+ * typical ratio and the reader stops wherever the memory actually runs
+ * out. Called by the reader, which fills the extents afterwards. */
+void layout_cdda_cache(struct CDDACache *cache, const struct PlayCDDATOC *toc, ULONG generation) {
+	struct CDDACacheExtent *ext;
+	LONG                    length[MAX_TRACKS];
+	ULONG                   avail = cache->cc_MemSize / CDDA_FRAME_SIZE;
+	ULONG                   used = 0;
+	LONG                    start, end;
+	int                     frames;
+	int                     i, n = 0;
+
+	cache->cc_TOC = *toc;
+
+	for (i = 0; i < toc->toc_NumTracks && n < MAX_TRACKS; i++) {
+		if (toc->toc_Type[i] != TRACK_CDDA)
+			continue;
+
+		if (!get_audio_run(toc, toc->toc_Addr[i], &start, &end))
+			break;
+
+		if (end > (LONG)toc->toc_Addr[i + 1])
+			end = toc->toc_Addr[i + 1];
+
+		ext = &cache->cc_Extent[n];
+
+		ext->ce_Generation = 0;
+		ext->ce_Addr       = start;
+		ext->ce_Frames     = 0;
+		ext->ce_Done       = 0;
+		ext->ce_Ready      = 0;
+
+		length[n++] = end - start;
+	}
+
+	if (cache->cc_Packed)
+		avail = (UQUAD)avail * 100 / CACHE_PACKED_PERCENT;
+
+	for (i = 0; i < n && avail > 0; i++) {
+		frames = cache->cc_IntroFrames;
+		if (frames > length[i])
+			frames = length[i];
+		if (frames > avail)
+			frames = avail;
+
+		cache->cc_Extent[i].ce_Frames = frames;
+		avail -= frames;
+	}
+
+	if (cache->cc_WholeDisc) {
+		for (i = 0; i < n && avail > 0; i++) {
+			frames = length[i] - cache->cc_Extent[i].ce_Frames;
+			if (frames > avail)
+				frames = avail;
+
+			cache->cc_Extent[i].ce_Frames += frames;
+			avail -= frames;
+		}
+	}
+
+	cache->cc_Complete    = TRUE;
+	cache->cc_FramesTotal = 0;
+
+	for (i = 0; i < n; i++) {
+		ext = &cache->cc_Extent[i];
+
+		if (ext->ce_Frames != length[i])
+			cache->cc_Complete = FALSE;
+
+		cache->cc_FramesTotal += ext->ce_Frames;
+
+		if (cache->cc_Packed) {
+			/* Block tables first, the packed data follows them */
+			ext->ce_Data   = NULL;
+			ext->ce_Blocks = (ULONG *)(cache->cc_Mem + used);
+			used += ((ext->ce_Frames + CACHE_BLOCK_FRAMES - 1) / CACHE_BLOCK_FRAMES) * sizeof(ULONG);
+		} else {
+			ext->ce_Data   = (UWORD *)(cache->cc_Mem + used);
+			ext->ce_Blocks = NULL;
+			used += ext->ce_Frames * CDDA_FRAME_SIZE;
+		}
+	}
+
+	cache->cc_NumExtents = n;
+	cache->cc_FramesDone = 0;
+	cache->cc_Used       = used;
+
+	MEMORY_BARRIER();
+	for (i = 0; i < n; i++)
+		cache->cc_Extent[i].ce_Generation = generation;
+}
+
+/* Where the reader should read the next frames of ext to, NULL if it has
+ * to use a buffer of its own for store_cdda_cache() to pack from */
+UWORD *cdda_cache_target(struct CDDACache *cache, struct CDDACacheExtent *ext) {
+	if (cache->cc_Packed)
+		return NULL;
+
+	return ext->ce_Data + (ext->ce_Done * CDDA_FRAME_SIZE / sizeof(UWORD));
+}
+
+/* Adds the frames read to ext and makes them available to the player.
+ * Returns the number stored, fewer if the memory ran out. */
+int store_cdda_cache(struct PlayCDDAData *pcd, struct CDDACache *cache, struct CDDACacheExtent *ext,
+	const UWORD *data, int frames)
+{
+	struct PlayCDDAPlayerStats *pcps = &pcd->pcd_PlayerData.pcpd_Stats;
+	const UBYTE                *src = (const UBYTE *)data;
+	ULONG                       size;
+	int                         stored = 0;
+	int                         block;
+
+	if (!cache->cc_Packed) {
+		stored = frames;
+	} else {
+		while (stored < frames) {
+			block = frames - stored;
+			if (block > CACHE_BLOCK_FRAMES)
+				block = CACHE_BLOCK_FRAMES;
+
+			size = pack_block(src, block, cache->cc_Mem + cache->cc_Used, cache->cc_MemSize - cache->cc_Used);
+			if (size == 0)
+				break;
+
+			ext->ce_Blocks[(ext->ce_Done + stored) / CACHE_BLOCK_FRAMES] = cache->cc_Used;
+			cache->cc_Used += size;
+
+			pcps->pcps_CachePacked += size;
+			pcps->pcps_CacheRaw    += block * CDDA_FRAME_SIZE;
+
+			src    += block * CDDA_FRAME_SIZE;
+			stored += block;
+		}
+	}
+
+	ext->ce_Done += stored;
+
+	MEMORY_BARRIER();
+	ext->ce_Ready = ext->ce_Done;
+
+	cache->cc_FramesDone += stored;
+
+	return stored;
+}
+
+/* Plan no more than what has been read so far, after a read error or
+ * when the memory has run out */
+void truncate_cdda_cache(struct CDDACache *cache, struct CDDACacheExtent *ext) {
+	int i;
+
+	for (i = 0; i < cache->cc_NumExtents; i++) {
+		if (ext != NULL && ext != &cache->cc_Extent[i])
+			continue;
+
+		cache->cc_FramesTotal -= cache->cc_Extent[i].ce_Frames - cache->cc_Extent[i].ce_Done;
+		cache->cc_Extent[i].ce_Frames = cache->cc_Extent[i].ce_Done;
+	}
+
+	cache->cc_Complete = FALSE;
+}
+
+/* Extent of the current layout with the frame at addr ready to play */
+const struct CDDACacheExtent *find_cdda_cache(const struct CDDACache *cache, LONG addr) {
+	const struct CDDACacheExtent *ext;
+	ULONG                         generation = cache->cc_Generation;
+	int                           i;
+
+	for (i = 0; i < cache->cc_NumExtents; i++) {
+		ext = &cache->cc_Extent[i];
+
+		if (ext->ce_Generation != generation)
+			continue;
+
+		MEMORY_BARRIER();
+		if (addr >= ext->ce_Addr && addr < ext->ce_Addr + ext->ce_Ready)
+			return ext;
+	}
+
+	return NULL;
+}
+
+/* Same, but moves addr past any data tracks first */
+const struct CDDACacheExtent *next_cdda_cache(const struct CDDACache *cache, LONG *addr) {
+	LONG start, end;
+
+	if (get_audio_run(&cache->cc_TOC, *addr, &start, &end))
+		*addr = start;
+
+	return find_cdda_cache(cache, *addr);
+}
+
+/* First frame to play from addr onwards that isn't in the cache */
+LONG cdda_cache_end(const struct CDDACache *cache, LONG addr) {
+	const struct CDDACacheExtent *ext;
+
+	while ((ext = next_cdda_cache(cache, &addr)) != NULL)
+		addr = ext->ce_Addr + ext->ce_Ready;
+
+	return addr;
+}
+
+/* Cached frames of ext from addr on that follow each other in memory.
+ * *data is set to the first of them, packed blocks are unpacked to buf,
+ * which has to hold CACHE_BLOCK_FRAMES. Called by the player. */
+int read_cdda_cache(const struct CDDACache *cache, const struct CDDACacheExtent *ext, LONG addr,
+	UWORD *buf, UWORD **data)
+{
+	int pos = addr - ext->ce_Addr;
+	int ready = ext->ce_Ready;
+	int start, frames;
+
+	MEMORY_BARRIER();
+
+	if (!cache->cc_Packed) {
+		*data = ext->ce_Data + (pos * CDDA_FRAME_SIZE / sizeof(UWORD));
+		return ready - pos;
+	}
+
+	start  = pos - (pos % CACHE_BLOCK_FRAMES);
+	frames = ready - start;
+	if (frames > CACHE_BLOCK_FRAMES)
+		frames = CACHE_BLOCK_FRAMES;
+
+	unpack_block(cache->cc_Mem + ext->ce_Blocks[start / CACHE_BLOCK_FRAMES], frames, (UBYTE *)buf);
+
+	*data = buf + ((pos - start) * CDDA_FRAME_SIZE / sizeof(UWORD));
+	return frames - (pos - start);
+}
@@ -38,6 +38,7 @@
 #endif
 
 #include <stdio.h>
+#include <stddef.h>
 
 #if defined(__AROS__) && defined(AROS_FAST_BPTR)
 #define IS_VALID_BPTR(bptr) (TRUE)
@@ -88,7 +89,7 @@ static int copy_bstr_to_c(BSTR bstr, char *dst, int dst_len) {
 	return src_len;
 }
 
-static BOOL has_command(UWORD *cmd_list, UWORD cmd) {
+static BOOL has_command(const UWORD *cmd_list, UWORD cmd) {
 	int i;
 
 	for (i = 0; cmd_list[i]; i++) {
@@ -99,12 +100,87 @@ static BOOL has_command(UWORD *cmd_list, UWORD cmd) {
 	return FALSE;
 }
 
-static BOOL is_cdrom_drive(struct PlayCDDAData *pcd, const char *device, ULONG unit, ULONG flags) {
+/* Whether the drive has an MMC feature, from GET CONFIGURATION with only
+ * that one returned, and the first byte of its feature dependent data */
+static BOOL get_feature(struct IOStdReq *ioreq, UWORD feature, UBYTE *data) {
+	struct SCSICmd scsicmd;
+	UBYTE          buffer[16];
+	UBYTE          sensebuffer[32];
+	UBYTE          cmd[10];
+
+	memset(buffer, 0, sizeof(buffer));
+	memset(&scsicmd, 0, sizeof(scsicmd));
+
+	cmd[0] = 0x46;
+	cmd[1] = 0x02; /* Only the starting feature */
+	cmd[2] = feature >> 8;
+	cmd[3] = feature & 0xFF;
+	cmd[4] = 0;
+	cmd[5] = 0;
+	cmd[6] = 0;
+	cmd[7] = 0;
+	cmd[8] = sizeof(buffer);
+	cmd[9] = 0;
+
+	scsicmd.scsi_Data        = (UWORD *)buffer;
+	scsicmd.scsi_Length      = sizeof(buffer);
+	scsicmd.scsi_SenseData   = sensebuffer;
+	scsicmd.scsi_SenseLength = sizeof(sensebuffer);
+	scsicmd.scsi_Command     = cmd;
+	scsicmd.scsi_CmdLength   = sizeof(cmd);
+	scsicmd.scsi_Flags       = SCSIF_READ | SCSIF_AUTOSENSE;
+
+	ioreq->io_Command = HD_SCSICMD;
+	ioreq->io_Data    = &scsicmd;
+	ioreq->io_Length  = sizeof(scsicmd);
+
+	if (DoIO((struct IORequest *)ioreq) != 0)
+		return FALSE;
+
+	/* Feature header, then the descriptor if it's supported */
+	if (scsicmd.scsi_Actual < 12 || (((UWORD)buffer[8] << 8) | buffer[9]) != feature)
+		return FALSE;
+
+	*data = (buffer[11] != 0 && scsicmd.scsi_Actual > 12) ? buffer[12] : 0;
+
+	return TRUE;
+}
+
+static ULONG get_features(struct IOStdReq *ioreq) {
+	ULONG features = 0;
+	UBYTE data;
+
+	/* Drives that don't know the command predate all of this */
+	if (!get_feature(ioreq, 0x0000, &data))
+		return 0;
+
+	features |= CDF_KNOWN;
+
+	if (get_feature(ioreq, 0x001E, &data)) {
+		features |= CDF_READCD;
+		if (data & 0x01)
+			features |= CDF_CDTEXT;
+		if (data & 0x02)
+			features |= CDF_C2;
+	}
+
+	if (get_feature(ioreq, 0x0107, &data) && (data & 0x08))
+		features |= CDF_SETSPEED;
+
+	return features;
+}
+
+/* Fills in caps for a CD drive, which is all that's asked of it later */
+static BOOL probe_cdrom_drive(struct PlayCDDAData *pcd, const char *device, ULONG unit, ULONG flags,
+	struct CDROMCaps *caps)
+{
 	struct MsgPort             *port;
 	struct IOStdReq            *ioreq = NULL;
 	struct NSDeviceQueryResult  nsdqr;
-	struct DriveGeometry        dg;
 	BOOL                        result = FALSE;
+	int                         i;
+
+	memset(caps, 0, sizeof(*caps));
 
 	port = create_msgport();
 	if (port == NULL)
@@ -132,6 +208,9 @@ static BOOL is_cdrom_drive(struct PlayCDDAData *pcd, const char *device, ULONG u
 
 		if (!has_command(nsdqr.SupportedCommands, HD_SCSICMD))
 			goto cleanup;
+
+		for (i = 0; i < MAX_NSD_COMMANDS && nsdqr.SupportedCommands[i]; i++)
+			caps->cap_Commands[i] = nsdqr.SupportedCommands[i];
 	} else {
 #ifdef RELAXED_NSD_CHECK
 		if (ioreq->io_Error != IOERR_NOCMD)
@@ -142,15 +221,17 @@ static BOOL is_cdrom_drive(struct PlayCDDAData *pcd, const char *device, ULONG u
 	}
 
 	ioreq->io_Command = TD_GETGEOMETRY;
-	ioreq->io_Data    = &dg;
-	ioreq->io_Length  = sizeof(dg);
+	ioreq->io_Data    = &caps->cap_Geometry;
+	ioreq->io_Length  = sizeof(caps->cap_Geometry);
 
 	if (DoIO((struct IORequest *)ioreq) != 0)
 		goto cleanup;
 
-	if (dg.dg_DeviceType != DG_CDROM)
+	if (caps->cap_Geometry.dg_DeviceType != DG_CDROM)
 		goto cleanup;
 
+	caps->cap_Features = get_features(ioreq);
+
 	result = TRUE;
 
 cleanup:
@@ -182,44 +263,320 @@ static void add_sorted(struct PlayCDDAData *pcd, struct List *list, struct Node
 }
 
 static BOOL add_cdrom_drive(struct PlayCDDAData *pcd, struct List *list, const char *drive,
-	const char *device, ULONG unit, ULONG flags)
+	const char *device, ULONG unit, ULONG flags, const struct CDROMCaps *caps, const char *image)
 {
 	struct CDROMDrive *cdd;
-	int drive_len, device_len;
+	int drive_len, device_len, image_len;
 
 	drive_len = strlen(drive) + 1;
 	device_len = strlen(device) + 1;
+	image_len = (image != NULL) ? strlen(image) + 1 : 0;
 
-	cdd = malloc(sizeof(*cdd) + drive_len + device_len);
+	cdd = malloc(sizeof(*cdd) + drive_len + device_len + image_len);
 	if (cdd == NULL)
 		return FALSE;
 
 	cdd->cdd_Node.ln_Name = (char *)(cdd + 1);
 	cdd->cdd_Device       = (CONST_STRPTR)(cdd->cdd_Node.ln_Name + drive_len);
+	cdd->cdd_Image        = NULL;
 
 	memcpy((APTR)cdd->cdd_Node.ln_Name, drive, drive_len);
 	memcpy((APTR)cdd->cdd_Device, device, device_len);
 
+	if (image != NULL) {
+		cdd->cdd_Image = cdd->cdd_Device + device_len;
+		memcpy((APTR)cdd->cdd_Image, image, image_len);
+	}
+
 	cdd->cdd_Unit  = unit;
 	cdd->cdd_Flags = flags;
 
+	if (caps != NULL)
+		cdd->cdd_Caps = *caps;
+	else
+		memset(&cdd->cdd_Caps, 0, sizeof(cdd->cdd_Caps));
+
 	add_sorted(pcd, list, &cdd->cdd_Node);
 
 	return TRUE;
 }
 
-BOOL get_cdrom_drives(struct PlayCDDAData *pcd, struct List *list) {
+/* A device/unit that one or more DOS devices are mounted from, probed only
+ * once however many partitions there are */
+struct DriveProbe {
+	struct MinNode     dp_Node;
+	struct PlayCDDAMsg dp_Msg;    /* Hands it to a probe process */
+	const char        *dp_Device;
+	ULONG              dp_Unit;
+	ULONG              dp_Flags;
+	BOOL               dp_Done;   /* dp_CDROM is known */
+	BOOL               dp_CDROM;
+	struct CDROMCaps   dp_Caps;
+};
+
+/* DOS device copied out of the DOS list */
+struct DOSDrive {
+	struct MinNode     dd_Node;
+	struct DriveProbe *dd_Probe;
+	const char        *dd_Name;
+	ULONG              dd_Flags;
+};
+
+/* Probing more devices at once than this gains nothing */
+#define MAX_PROBE_PROCS 8
+
+#define PROBE_PROC_PRI 0
+
+/* Probe results from earlier runs. An entry is only used while the device
+ * that it's for is loaded at the same version, so that updating a driver
+ * probes again. */
+#define DRIVE_CACHE_DIR  "ENVARC:PlayCDDA"
+#define DRIVE_CACHE_FILE "ENVARC:PlayCDDA/Drives"
+
+#define DRIVE_CACHE_MAGIC   0x50434444 /* 'PCDD' */
+#define DRIVE_CACHE_VERSION 2
+
+#define MAX_CACHED_DRIVES 64
+
+struct DriveCacheEntry {
+	char             dce_Device[64];
+	ULONG            dce_Unit;
+	ULONG            dce_Flags;
+	UWORD            dce_Version;
+	UWORD            dce_Revision;
+	ULONG            dce_CDROM;
+	struct CDROMCaps dce_Caps;
+};
+
+struct DriveCache {
+	ULONG                  dch_Magic;
+	ULONG                  dch_Version;
+	ULONG                  dch_NumEntries;
+	struct DriveCacheEntry dch_Entry[MAX_CACHED_DRIVES];
+};
+
+/* Version of the device if it's already loaded. Opening it to find out
+ * would cost as much as probing it. */
+static BOOL get_device_version(const char *device, UWORD *version, UWORD *revision) {
+	const struct ExecBase *exec = (const struct ExecBase *)SysBase;
+	struct Device         *dev;
+
+	Forbid();
+
+	dev = (struct Device *)FindName((struct List *)&exec->DeviceList, (CONST_STRPTR)device);
+	if (dev != NULL) {
+		*version  = dev->dd_Library.lib_Version;
+		*revision = dev->dd_Library.lib_Revision;
+	}
+
+	Permit();
+
+	return (dev != NULL);
+}
+
+static void read_drive_cache(struct DriveCache *dch) {
+	BPTR file;
+
+	dch->dch_NumEntries = 0;
+
+	file = Open((CONST_STRPTR)DRIVE_CACHE_FILE, MODE_OLDFILE);
+	if (file == ZERO)
+		return;
+
+	if (Read(file, dch, sizeof(*dch)) < (LONG)offsetof(struct DriveCache, dch_Entry) ||
+		dch->dch_Magic != DRIVE_CACHE_MAGIC || dch->dch_Version != DRIVE_CACHE_VERSION ||
+		dch->dch_NumEntries > MAX_CACHED_DRIVES)
+	{
+		dch->dch_NumEntries = 0;
+	}
+
+	Close(file);
+}
+
+static void write_drive_cache(struct DriveCache *dch) {
+	BPTR file, lock;
+	LONG size;
+
+	lock = Lock((CONST_STRPTR)DRIVE_CACHE_DIR, ACCESS_READ);
+	if (lock == ZERO)
+		lock = CreateDir((CONST_STRPTR)DRIVE_CACHE_DIR);
+
+	if (lock == ZERO)
+		return;
+
+	UnLock(lock);
+
+	file = Open((CONST_STRPTR)DRIVE_CACHE_FILE, MODE_NEWFILE);
+	if (file == ZERO)
+		return;
+
+	dch->dch_Magic   = DRIVE_CACHE_MAGIC;
+	dch->dch_Version = DRIVE_CACHE_VERSION;
+
+	size = offsetof(struct DriveCache, dch_Entry) + dch->dch_NumEntries * sizeof(struct DriveCacheEntry);
+
+	if (Write(file, dch, size) != size) {
+		Close(file);
+		DeleteFile((CONST_STRPTR)DRIVE_CACHE_FILE);
+		return;
+	}
+
+	Close(file);
+}
+
+static struct DriveCacheEntry *find_cached_drive(struct DriveCache *dch, const struct DriveProbe *dp) {
+	struct DriveCacheEntry *dce;
+	ULONG                   i;
+
+	for (i = 0; i < dch->dch_NumEntries; i++) {
+		dce = &dch->dch_Entry[i];
+
+		if (dce->dce_Unit == dp->dp_Unit && dce->dce_Flags == dp->dp_Flags &&
+			strncmp(dce->dce_Device, dp->dp_Device, sizeof(dce->dce_Device)) == 0)
+		{
+			return dce;
+		}
+	}
+
+	return NULL;
+}
+
+static int probe_proc_entry(void) {
+	struct Process     *me;
+	struct PlayCDDAMsg *pcm;
+	struct DriveProbe  *dp;
+
+	me = (struct Process *)FindTask(NULL);
+
+	WaitPort(&me->pr_MsgPort);
+	pcm = (struct PlayCDDAMsg *)GetMsg(&me->pr_MsgPort);
+
+	dp = (struct DriveProbe *)pcm->pcm_Arg1;
+	dp->dp_CDROM = probe_cdrom_drive(pcm->pcm_GlobalData, dp->dp_Device, dp->dp_Unit, dp->dp_Flags, &dp->dp_Caps);
+
+	/* Our exit breaks the Forbid(), so the program can't be unloaded
+	 * under us once the reply is seen */
+	Forbid();
+	ReplyMsg(&pcm->pcm_Msg);
+
+	return RETURN_OK;
+}
+
+/* Starts probing dp from a process of its own, the result comes back to
+ * reply_port. FALSE if it has to be probed here instead. */
+static BOOL start_probe_proc(struct PlayCDDAData *pcd, struct DriveProbe *dp, struct MsgPort *reply_port) {
+	struct Process *proc;
+
+	dp->dp_Msg.pcm_Msg.mn_Node.ln_Type = NT_MESSAGE;
+	dp->dp_Msg.pcm_Msg.mn_ReplyPort    = reply_port;
+	dp->dp_Msg.pcm_Msg.mn_Length       = sizeof(dp->dp_Msg);
+
+	dp->dp_Msg.pcm_GlobalData = pcd;
+	dp->dp_Msg.pcm_Command    = PCC_STARTUP;
+	dp->dp_Msg.pcm_Arg1       = (pcm_arg_t)dp;
+
+	proc = CreateNewProcTags(
+		NP_Name,        "PlayCDDA Probe Process",
+		NP_Entry,       &probe_proc_entry,
+		NP_StackSize,   8192,
+		NP_Priority,    PROBE_PROC_PRI,
+		NP_CurrentDir,  0,
+		NP_Path,        0,
+		NP_CopyVars,    FALSE,
+		NP_Input,       0,
+		NP_Output,      0,
+		NP_Error,       0,
+		NP_CloseInput,  FALSE,
+		NP_CloseOutput, FALSE,
+		NP_CloseError,  FALSE,
+		TAG_END);
+	if (proc == NULL)
+		return FALSE;
+
+	PutMsg(&proc->pr_MsgPort, &dp->dp_Msg.pcm_Msg);
+
+	return TRUE;
+}
+
+/* Probes everything that the cache couldn't answer for, several devices
+ * at a time */
+static void probe_drives(struct PlayCDDAData *pcd, struct MinList *probes) {
+	struct MsgPort    *reply_port;
+	struct MinNode    *node;
+	struct DriveProbe *dp;
+	int                running = 0;
+
+	reply_port = create_msgport();
+
+	for (node = probes->mlh_Head; node->mln_Succ != NULL; node = node->mln_Succ) {
+		dp = (struct DriveProbe *)node;
+		if (dp->dp_Done)
+			continue;
+
+		while (running >= MAX_PROBE_PROCS) {
+			WaitPort(reply_port);
+			while (GetMsg(reply_port) != NULL)
+				running--;
+		}
+
+		if (reply_port != NULL && start_probe_proc(pcd, dp, reply_port))
+			running++;
+		else
+			dp->dp_CDROM = probe_cdrom_drive(pcd, dp->dp_Device, dp->dp_Unit, dp->dp_Flags, &dp->dp_Caps);
+	}
+
+	while (running > 0) {
+		WaitPort(reply_port);
+		while (GetMsg(reply_port) != NULL)
+			running--;
+	}
+
+	delete_msgport(reply_port);
+}
+
+static struct DriveProbe *get_drive_probe(struct MinList *probes, const char *device, ULONG unit, ULONG flags) {
+	struct MinNode    *node;
+	struct DriveProbe *dp;
+	int                device_len;
+
+	for (node = probes->mlh_Head; node->mln_Succ != NULL; node = node->mln_Succ) {
+		dp = (struct DriveProbe *)node;
+
+		if (dp->dp_Unit == unit && strcmp(dp->dp_Device, device) == 0)
+			return dp;
+	}
+
+	device_len = strlen(device) + 1;
+
+	dp = malloc(sizeof(*dp) + device_len);
+	if (dp == NULL)
+		return NULL;
+
+	memset(dp, 0, sizeof(*dp));
+
+	dp->dp_Device = (const char *)(dp + 1);
+	dp->dp_Unit   = unit;
+	dp->dp_Flags  = flags;
+
+	memcpy((APTR)dp->dp_Device, device, device_len);
+
+	AddTail((struct List *)probes, (struct Node *)&dp->dp_Node);
+
+	return dp;
+}
+
+/* Copies the DOS devices out of the DOS list, so that it isn't locked while
+ * they're probed */
+static int copy_dos_drives(struct MinList *drives, struct MinList *probes) {
 	struct DosList           *dl;
 	struct DeviceNode        *dn;
 	struct FileSysStartupMsg *fssm;
+	struct DOSDrive          *dd;
 	char                      drive[256];
 	char                      device[256];
-	ULONG                     unit;
-	ULONG                     flags;
+	int                       drive_len;
 	int                       errors = 0;
 
-	NewList(list);
-
 	dl = LockDosList(LDF_DEVICES | LDF_READ);
 
 	while ((dl = NextDosEntry(dl, LDF_DEVICES)) != NULL) {
@@ -231,19 +588,156 @@ BOOL get_cdrom_drives(struct PlayCDDAData *pcd, struct List *list) {
 			copy_bstr_to_c(dn->dn_Name, drive, sizeof(drive));
 			copy_bstr_to_c(fssm->fssm_Device, device, sizeof(device));
 
-			unit  = fssm->fssm_Unit;
-			flags = fssm->fssm_Flags;
+			drive_len = strlen(drive) + 1;
 
-			if (is_cdrom_drive(pcd, device, unit, flags)) {
-				/* Add it to the list */
-				if (!add_cdrom_drive(pcd, list, drive, device, unit, flags))
-					errors++;
+			dd = malloc(sizeof(*dd) + drive_len);
+			if (dd == NULL) {
+				errors++;
+				continue;
 			}
+
+			dd->dd_Name  = (const char *)(dd + 1);
+			dd->dd_Flags = fssm->fssm_Flags;
+			dd->dd_Probe = get_drive_probe(probes, device, fssm->fssm_Unit, fssm->fssm_Flags);
+
+			memcpy((APTR)dd->dd_Name, drive, drive_len);
+
+			if (dd->dd_Probe == NULL) {
+				free(dd);
+				errors++;
+				continue;
+			}
+
+			AddTail((struct List *)drives, (struct Node *)&dd->dd_Node);
 		}
 	}
 
 	UnLockDosList(LDF_DEVICES | LDF_READ);
 
+	return errors;
+}
+
+BOOL get_cdrom_drives(struct PlayCDDAData *pcd, struct List *list) {
+	struct MinList          drives, probes;
+	struct MinNode         *node;
+	struct DOSDrive        *dd;
+	struct DriveProbe      *dp;
+	struct DriveCache      *dch;
+	struct DriveCacheEntry *dce;
+	UWORD                   version, revision;
+	BOOL                    changed = FALSE;
+	int                     errors;
+
+	NewList(list);
+	NewList((struct List *)&drives);
+	NewList((struct List *)&probes);
+
+	errors = copy_dos_drives(&drives, &probes);
+
+	dch = malloc(sizeof(*dch));
+	if (dch != NULL)
+		read_drive_cache(dch);
+
+	for (node = probes.mlh_Head; dch != NULL && node->mln_Succ != NULL; node = node->mln_Succ) {
+		dp = (struct DriveProbe *)node;
+
+		dce = find_cached_drive(dch, dp);
+		if (dce != NULL && get_device_version(dp->dp_Device, &version, &revision) &&
+			dce->dce_Version == version && dce->dce_Revision == revision)
+		{
+			dp->dp_CDROM = dce->dce_CDROM;
+			dp->dp_Caps  = dce->dce_Caps;
+			dp->dp_Done = TRUE;
+		}
+	}
+
+	probe_drives(pcd, &probes);
+
+	/* Rewritten with what's mounted now, so that it doesn't keep growing,
+	 * but only if something new was learned */
+	if (dch != NULL) {
+		dch->dch_NumEntries = 0;
+
+		for (node = probes.mlh_Head; node->mln_Succ != NULL; node = node->mln_Succ) {
+			dp = (struct DriveProbe *)node;
+
+			if (dch->dch_NumEntries == MAX_CACHED_DRIVES ||
+				strlen(dp->dp_Device) >= sizeof(dce->dce_Device) ||
+				!get_device_version(dp->dp_Device, &version, &revision))
+			{
+				continue;
+			}
+
+			if (!dp->dp_Done)
+				changed = TRUE;
+
+			dce = &dch->dch_Entry[dch->dch_NumEntries++];
+
+			memset(dce, 0, sizeof(*dce));
+			strcpy(dce->dce_Device, dp->dp_Device);
+
+			dce->dce_Unit     = dp->dp_Unit;
+			dce->dce_Flags    = dp->dp_Flags;
+			dce->dce_Version  = version;
+			dce->dce_Revision = revision;
+			dce->dce_CDROM    = dp->dp_CDROM;
+			dce->dce_Caps     = dp->dp_Caps;
+		}
+
+		if (changed)
+			write_drive_cache(dch);
+
+		free(dch);
+	}
+
+	while ((node = (struct MinNode *)RemHead((struct List *)&drives)) != NULL) {
+		dd = (struct DOSDrive *)node;
+		dp = dd->dd_Probe;
+
+		if (dp->dp_CDROM) {
+			/* Add it to the list */
+			if (!add_cdrom_drive(pcd, list, dd->dd_Name, dp->dp_Device, dp->dp_Unit, dd->dd_Flags, &dp->dp_Caps, NULL))
+				errors++;
+		}
+
+		free(dd);
+	}
+
+	while ((node = (struct MinNode *)RemHead((struct List *)&probes)) != NULL)
+		free(node);
+
+	return (errors == 0);
+}
+
+/* Disc images from a list of paths separated by '|', listed under their
+ * file names. Whether they can be used is only checked when opened. */
+BOOL add_image_drives(struct PlayCDDAData *pcd, struct List *list, const char *paths) {
+	char        path[1024];
+	const char *end;
+	size_t      len;
+	ULONG       unit = 0;
+	int         errors = 0;
+
+	for (; *paths != '\0'; paths = end) {
+		end = paths + strcspn(paths, "|");
+
+		len = end - paths;
+		if (len >= sizeof(path))
+			len = sizeof(path) - 1;
+
+		memcpy(path, paths, len);
+		path[len] = '\0';
+
+		if (*end != '\0')
+			end++;
+
+		if (path[0] == '\0')
+			continue;
+
+		if (!add_cdrom_drive(pcd, list, (const char *)FilePart((STRPTR)path), "image", unit++, 0, NULL, path))
+			errors++;
+	}
+
 	return (errors == 0);
 }
 
@@ -328,7 +822,8 @@ static BOOL add_dc_handler(struct PlayCDDAData *pcd) {
 	dci->dci_Interrupt.is_Node.ln_Name = (STRPTR)"PlayCDDA disk change interrupt";
 	dci->dci_Interrupt.is_Data = dci;
 
-	dci->dci_Task   = FindTask(NULL);
+	/* Opened by the drive process, but the GUI waits for disc changes */
+	dci->dci_Task   = &pcd->pcd_MainProc->pr_Task;
 	dci->dci_Signal = (ULONG)1 << pcd->pcd_DCSignal;
 
 	pcd->pcd_DCInterrupt = (struct Interrupt *)dci;
@@ -352,10 +847,13 @@ cleanup:
 	return FALSE;
 }
 
+/* The rest was checked when the drive was probed, but the probe may have
+ * come from the drive list in ENVARC: and the unit may since be something
+ * else, so the device type is checked again */
 BOOL open_cdrom_drive(struct PlayCDDAData *pcd, struct CDROMDrive *cdd) {
-	struct IOStdReq            *ioreq;
-	struct NSDeviceQueryResult  nsdqr;
-	struct DriveGeometry        dg;
+	const struct CDROMCaps *caps = &cdd->cdd_Caps;
+	struct IOStdReq        *ioreq;
+	struct DriveGeometry    dg;
 
 	close_cdrom_drive(pcd);
 
@@ -369,46 +867,38 @@ BOOL open_cdrom_drive(struct PlayCDDAData *pcd, struct CDROMDrive *cdd) {
 
 	pcd->pcd_CDReq = ioreq;
 
-	if (OpenDevice((CONST_STRPTR)cdd->cdd_Device, cdd->cdd_Unit, (struct IORequest *)ioreq, cdd->cdd_Flags) != 0) {
+	if (cdd->cdd_Image != NULL) {
+		/* The reader still makes copies of the IORequest, but reads from
+		 * the image instead of sending them. There are no disc changes. */
 		ioreq->io_Device = NULL;
-		goto cleanup;
-	}
 
-	nsdqr.DevQueryFormat = 0;
-	nsdqr.SizeAvailable  = 0;
+		pcd->pcd_Image = open_cd_image((const char *)cdd->cdd_Image);
+		if (pcd->pcd_Image == NULL)
+			goto cleanup;
 
-	ioreq->io_Command = NSCMD_DEVICEQUERY;
-	ioreq->io_Data    = &nsdqr;
-	ioreq->io_Length  = sizeof(nsdqr);
+		pcd->pcd_CurrentDrive = cdd;
 
-	if (DoIO((struct IORequest *)ioreq) == 0) {
-		if (nsdqr.DeviceType != NSDEVTYPE_TRACKDISK)
-			goto cleanup;
+		return TRUE;
+	}
 
-		if (!has_command(nsdqr.SupportedCommands, HD_SCSICMD))
-			goto cleanup;
-	} else {
-#ifdef RELAXED_NSD_CHECK
-		if (ioreq->io_Error != IOERR_NOCMD)
-			goto cleanup;
-#else
+	if (OpenDevice((CONST_STRPTR)cdd->cdd_Device, cdd->cdd_Unit, (struct IORequest *)ioreq, cdd->cdd_Flags) != 0) {
+		ioreq->io_Device = NULL;
 		goto cleanup;
-#endif
 	}
 
 	ioreq->io_Command = TD_GETGEOMETRY;
 	ioreq->io_Data    = &dg;
 	ioreq->io_Length  = sizeof(dg);
 
-	if (DoIO((struct IORequest *)ioreq) != 0)
-		goto cleanup;
-
-	if (dg.dg_DeviceType != DG_CDROM)
+	if (DoIO((struct IORequest *)ioreq) != 0 || dg.dg_DeviceType != DG_CDROM)
 		goto cleanup;
 
 	pcd->pcd_CurrentDrive = cdd;
 
-	add_dc_handler(pcd);
+	/* A device that lists its commands without TD_ADDCHANGEINT can't tell
+	 * us about disc changes */
+	if (caps->cap_Commands[0] == 0 || has_command(caps->cap_Commands, TD_ADDCHANGEINT))
+		add_dc_handler(pcd);
 
 	return TRUE;
 
@@ -418,6 +908,11 @@ cleanup:
 }
 
 void close_cdrom_drive(struct PlayCDDAData *pcd) {
+	if (pcd->pcd_Image != NULL) {
+		close_cd_image(pcd->pcd_Image);
+		pcd->pcd_Image = NULL;
+	}
+
 	if (pcd->pcd_CDReq != NULL) {
 		rem_dc_handler(pcd);
 
@@ -434,6 +929,38 @@ void close_cdrom_drive(struct PlayCDDAData *pcd) {
 	}
 }
 
+/* Track number that the last session starts with, from READ TOC format 1.
+ * 0 if it can't be read. */
+static int read_last_session(struct IOStdReq *ioreq) {
+	struct SCSICmd     scsicmd;
+	UBYTE              buffer[12];
+	UBYTE              sensebuffer[32];
+	static const UBYTE cmd[10] = { 0x43, 0, 1, 0, 0, 0, 0, 0, sizeof(buffer), 0 };
+
+	memset(&scsicmd, 0, sizeof(scsicmd));
+
+	scsicmd.scsi_Data        = (UWORD *)buffer;
+	scsicmd.scsi_Length      = sizeof(buffer);
+	scsicmd.scsi_SenseData   = sensebuffer;
+	scsicmd.scsi_SenseLength = sizeof(sensebuffer);
+	scsicmd.scsi_Command     = (UBYTE *)cmd;
+	scsicmd.scsi_CmdLength   = sizeof(cmd);
+	scsicmd.scsi_Flags       = SCSIF_READ | SCSIF_AUTOSENSE;
+
+	ioreq->io_Command = HD_SCSICMD;
+	ioreq->io_Data    = &scsicmd;
+	ioreq->io_Length  = sizeof(scsicmd);
+
+	if (DoIO((struct IORequest *)ioreq) != 0 || scsicmd.scsi_Actual < sizeof(buffer))
+		return 0;
+
+	/* Only one session */
+	if (buffer[2] == buffer[3])
+		return 0;
+
+	return buffer[6];
+}
+
 BOOL read_toc(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
 	struct IOStdReq   *ioreq;
 	struct SCSICmd     scsicmd;
@@ -441,10 +968,15 @@ BOOL read_toc(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
 	UBYTE              sensebuffer[128];
 	static const UBYTE cmd[10] = { 0x43, 0, 0, 0, 0, 0, 0, 0x03, 0x24, 0 };
 	int                tocsize, tracks, i;
-	int                bp;
+	int                bp, session;
 
 	memset(toc, 0, sizeof(*toc));
 
+	if (pcd->pcd_Image != NULL) {
+		*toc = pcd->pcd_Image->ci_TOC;
+		return TRUE;
+	}
+
 	ioreq = pcd->pcd_CDReq;
 	if (ioreq == NULL)
 		return FALSE;
@@ -489,6 +1021,132 @@ BOOL read_toc(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
 	                 | ((ULONG)buffer[bp + 6] << 8)
 	                 |  (ULONG)buffer[bp + 7];
 
+	/* Made an index like the tracks, from the first track number */
+	session = read_last_session(ioreq) - buffer[2];
+	if (session > 0 && session < tracks)
+		toc->toc_SessionTrack = session;
+
 	return TRUE;
 }
 
+/* The drive's count of disc changes, without any SCSI traffic */
+BOOL get_disc_change_count(struct PlayCDDAData *pcd, ULONG *count) {
+	struct IOStdReq *ioreq = pcd->pcd_CDReq;
+
+	if (pcd->pcd_Image != NULL || ioreq == NULL)
+		return FALSE;
+
+	ioreq->io_Command = TD_CHANGENUM;
+	ioreq->io_Data    = NULL;
+	ioreq->io_Length  = 0;
+
+	if (DoIO((struct IORequest *)ioreq) != 0)
+		return FALSE;
+
+	*count = ioreq->io_Actual;
+
+	return TRUE;
+}
+
+/* Number of tracks and the lead-out address, from a READ TOC that returns
+ * only the lead-out. Tells discs apart almost as well as the whole TOC.
+ * Both are 0 if there's no disc, like in an empty TOC. */
+void read_disc_id(struct PlayCDDAData *pcd, int *tracks, LONG *leadout) {
+	struct IOStdReq   *ioreq = pcd->pcd_CDReq;
+	struct SCSICmd     scsicmd;
+	UBYTE              buffer[12];
+	UBYTE              sensebuffer[32];
+	static const UBYTE cmd[10] = { 0x43, 0, 0, 0, 0, 0, 0xAA, 0, sizeof(buffer), 0 };
+
+	*tracks  = 0;
+	*leadout = 0;
+
+	if (pcd->pcd_Image != NULL) {
+		*tracks  = pcd->pcd_Image->ci_TOC.toc_NumTracks;
+		*leadout = pcd->pcd_Image->ci_TOC.toc_Addr[*tracks];
+		return;
+	}
+
+	if (ioreq == NULL)
+		return;
+
+	memset(&scsicmd, 0, sizeof(scsicmd));
+
+	scsicmd.scsi_Data        = (UWORD *)buffer;
+	scsicmd.scsi_Length      = sizeof(buffer);
+	scsicmd.scsi_SenseData   = sensebuffer;
+	scsicmd.scsi_SenseLength = sizeof(sensebuffer);
+	scsicmd.scsi_Command     = (UBYTE *)cmd;
+	scsicmd.scsi_CmdLength   = sizeof(cmd);
+	scsicmd.scsi_Flags       = SCSIF_READ | SCSIF_AUTOSENSE;
+
+	ioreq->io_Command = HD_SCSICMD;
+	ioreq->io_Data    = &scsicmd;
+	ioreq->io_Length  = sizeof(scsicmd);
+
+	if (DoIO((struct IORequest *)ioreq) != 0 || scsicmd.scsi_Actual < sizeof(buffer))
+		return;
+
+	*tracks  = buffer[3] - buffer[2] + 1;
+	*leadout = ((ULONG)buffer[8] << 24)
+	         | ((ULONG)buffer[9] << 16)
+	         | ((ULONG)buffer[10] << 8)
+	         |  (ULONG)buffer[11];
+}
+
+/* Audio tracks followed by a data track in a second session (Enhanced CD)
+ * end this many frames before it, for the lead-out, lead-in and pregap */
+#define SESSION_GAP_FRAMES 11400
+
+/* Run of consecutive audio tracks that contains addr, or the next one after
+ * it. Data tracks and the session gap in front of the last session are
+ * skipped. */
+BOOL get_audio_run(const struct PlayCDDATOC *toc, LONG addr, LONG *start_addr, LONG *end_addr) {
+	LONG start, end;
+	int  i, j;
+
+	for (i = 0; i < toc->toc_NumTracks; i = j) {
+		if (toc->toc_Type[i] != TRACK_CDDA) {
+			j = i + 1;
+			continue;
+		}
+
+		for (j = i + 1; j < toc->toc_NumTracks; j++) {
+			if (toc->toc_Type[j] != TRACK_CDDA)
+				break;
+		}
+
+		start = toc->toc_Addr[i];
+		end   = toc->toc_Addr[j];
+
+		if (j == toc->toc_SessionTrack && (end - start) > SESSION_GAP_FRAMES)
+			end -= SESSION_GAP_FRAMES;
+
+		if (addr < end) {
+			*start_addr = (addr > start) ? addr : start;
+			*end_addr   = end;
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+/* Play range from the start of a track up to the end of the last audio
+ * track. The reader skips any data tracks in between. */
+BOOL get_play_range(const struct PlayCDDATOC *toc, int track, LONG *start_addr, LONG *end_addr) {
+	LONG start;
+	int  i;
+
+	if (track < 0 || track >= toc->toc_NumTracks || toc->toc_Type[track] != TRACK_CDDA)
+		return FALSE;
+
+	for (i = toc->toc_NumTracks - 1; i > track; i--) {
+		if (toc->toc_Type[i] == TRACK_CDDA)
+			break;
+	}
+
+	*start_addr = toc->toc_Addr[track];
+
+	return get_audio_run(toc, toc->toc_Addr[i], &start, end_addr);
+}
@@ -0,0 +1,138 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+#ifdef __amigaos4__
+#include <exec/exectags.h>
+#elif defined(__i386__)
+#include <cpuid.h>
+#endif
+
+/* Swap the bytes of every 16-bit sample, two samples at a time */
+void swap_samples_scalar(const void *src, void *dst, ULONG size) {
+	const ULONG *s = src;
+	ULONG       *d = dst;
+	ULONG        x;
+
+	if (((size_t)src | (size_t)dst) & 3) {
+		const UBYTE *sb = src;
+		UBYTE       *db = dst;
+		UBYTE        b;
+
+		for (; size >= 2; size -= 2) {
+			b     = sb[0];
+			db[0] = sb[1];
+			db[1] = b;
+			sb += 2;
+			db += 2;
+		}
+		return;
+	}
+
+	for (; size >= 16; size -= 16) {
+		x = s[0]; d[0] = ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF);
+		x = s[1]; d[1] = ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF);
+		x = s[2]; d[2] = ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF);
+		x = s[3]; d[3] = ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF);
+		s += 4;
+		d += 4;
+	}
+
+	for (; size >= 4; size -= 4) {
+		x = *s++;
+		*d++ = ((x & 0x00FF00FF) << 8) | ((x >> 8) & 0x00FF00FF);
+	}
+
+	if (size >= 2) {
+		const UWORD *sw = (const UWORD *)s;
+		UWORD       *dw = (UWORD *)d;
+
+		*dw = (*sw << 8) | (*sw >> 8);
+	}
+}
+
+/* Gain is Q16 with 0x10000 as unity, applied as Q15 so that the SIMD
+ * kernels can use 16-bit multiplies. Rounds the same way as vec_mradds(). */
+static inline WORD scale_sample(UWORD sample, LONG gain15) {
+#ifdef WORDS_BIGENDIAN
+	sample = (sample << 8) | (sample >> 8);
+#endif
+
+	return ((LONG)(WORD)sample * gain15 + 0x4000) >> 15;
+}
+
+/* Converts to native byte order and applies gain in the same pass. The
+ * gain changes by step after every sample frame, so a volume change is
+ * spread over the whole buffer instead of happening in one jump. */
+void scale_samples_scalar(const void *src, void *dst, ULONG size, LONG gain, LONG step) {
+	const UWORD *s = src;
+	WORD        *d = dst;
+	ULONG        frames;
+	LONG         gain15;
+
+	for (frames = size / 4; frames != 0; frames--) {
+		gain15 = gain >> 1;
+		if (gain15 > 0x7FFF)
+			gain15 = 0x7FFF;
+
+		d[0] = scale_sample(s[0], gain15);
+		d[1] = scale_sample(s[1], gain15);
+
+		s += 2;
+		d += 2;
+		gain += step;
+	}
+}
+
+void init_convert(struct PlayCDDAData *pcd) {
+	pcd->pcd_SwapSamples  = swap_samples_scalar;
+	pcd->pcd_ScaleSamples = scale_samples_scalar;
+
+#ifdef __amigaos4__
+	{
+		ULONG vecunit = VECTORTYPE_NONE;
+
+		GetCPUInfoTags(GCIT_VectorUnit, &vecunit, TAG_END);
+
+		if (vecunit == VECTORTYPE_ALTIVEC) {
+			pcd->pcd_SwapSamples  = swap_samples_altivec;
+			pcd->pcd_ScaleSamples = scale_samples_altivec;
+		}
+	}
+#elif defined(__x86_64__)
+	pcd->pcd_ScaleSamples = scale_samples_sse2;
+#elif defined(__i386__)
+	{
+		unsigned int eax, ebx, ecx, edx;
+
+		if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2))
+			pcd->pcd_ScaleSamples = scale_samples_sse2;
+	}
+#endif
+}
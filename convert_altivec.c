@@ -0,0 +1,122 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Built with -maltivec, only called if init_convert() found a vector unit */
+
+#include "playcdda.h"
+
+#ifdef __ALTIVEC__
+
+#include <altivec.h>
+
+void swap_samples_altivec(const void *src, void *dst, ULONG size) {
+	const vector unsigned char perm = {
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+	};
+	const UBYTE *s = src;
+	UBYTE       *d = dst;
+
+	if ((((size_t)src | (size_t)dst) & 15) == 0) {
+		for (; size >= 64; size -= 64) {
+			vector unsigned char v0 = vec_ld(0, s);
+			vector unsigned char v1 = vec_ld(16, s);
+			vector unsigned char v2 = vec_ld(32, s);
+			vector unsigned char v3 = vec_ld(48, s);
+
+			vec_st(vec_perm(v0, v0, perm), 0, d);
+			vec_st(vec_perm(v1, v1, perm), 16, d);
+			vec_st(vec_perm(v2, v2, perm), 32, d);
+			vec_st(vec_perm(v3, v3, perm), 48, d);
+
+			s += 64;
+			d += 64;
+		}
+
+		for (; size >= 16; size -= 16) {
+			vector unsigned char v = vec_ld(0, s);
+
+			vec_st(vec_perm(v, v, perm), 0, d);
+
+			s += 16;
+			d += 16;
+		}
+	}
+
+	if (size != 0)
+		swap_samples_scalar(s, d, size);
+}
+
+void scale_samples_altivec(const void *src, void *dst, ULONG size, LONG gain, LONG step) {
+	const vector unsigned char perm = {
+		1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+	};
+	const vector unsigned int      one  = vec_splat_u32(1);
+	const vector signed short      zero = vec_splat_s16(0);
+	int                            init[8] __attribute__((aligned(16)));
+	vector signed int              g0, g1, inc;
+	vector signed short            v, gv;
+	const UBYTE                   *s = src;
+	UBYTE                         *d = dst;
+
+	if ((((size_t)src | (size_t)dst) & 15) == 0 && size >= 16) {
+		/* Four sample frames per vector, both channels get the same gain */
+		init[0] = init[1] = gain;
+		init[2] = init[3] = gain + step;
+		init[4] = init[5] = gain + step * 2;
+		init[6] = init[7] = gain + step * 3;
+
+		g0 = vec_ld(0, init);
+		g1 = vec_ld(16, init);
+
+		init[0] = init[1] = init[2] = init[3] = step * 4;
+
+		inc = vec_ld(0, init);
+
+		for (; size >= 16; size -= 16) {
+			v = (vector signed short)vec_ld(0, s);
+			v = vec_perm(v, v, perm);
+
+			/* Q16 to Q15, saturating unity to 0x7FFF */
+			gv = vec_packs(vec_sra(g0, one), vec_sra(g1, one));
+
+			vec_st(vec_mradds(v, gv, zero), 0, (short *)d);
+
+			g0 = vec_add(g0, inc);
+			g1 = vec_add(g1, inc);
+
+			s += 16;
+			d += 16;
+			gain += step * 4;
+		}
+	}
+
+	if (size != 0)
+		scale_samples_scalar(s, d, size, gain, step);
+}
+
+#endif
@@ -0,0 +1,74 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+#if defined(__i386__) || defined(__x86_64__)
+
+#include <emmintrin.h>
+
+__attribute__((target("sse2")))
+void scale_samples_sse2(const void *src, void *dst, ULONG size, LONG gain, LONG step) {
+	const UBYTE *s = src;
+	UBYTE       *d = dst;
+	__m128i      g0, g1, inc, round;
+	__m128i      v, gv, lo, hi, p0, p1;
+
+	/* Four sample frames per vector, both channels get the same gain */
+	g0    = _mm_set_epi32(gain + step, gain + step, gain, gain);
+	g1    = _mm_set_epi32(gain + step * 3, gain + step * 3, gain + step * 2, gain + step * 2);
+	inc   = _mm_set1_epi32(step * 4);
+	round = _mm_set1_epi32(0x4000);
+
+	for (; size >= 16; size -= 16) {
+		v = _mm_loadu_si128((const __m128i *)s);
+
+		/* Q16 to Q15, saturating unity to 0x7FFF */
+		gv = _mm_packs_epi32(_mm_srai_epi32(g0, 1), _mm_srai_epi32(g1, 1));
+
+		/* Full 32-bit products, rounded like the scalar kernel */
+		lo = _mm_mullo_epi16(v, gv);
+		hi = _mm_mulhi_epi16(v, gv);
+		p0 = _mm_srai_epi32(_mm_add_epi32(_mm_unpacklo_epi16(lo, hi), round), 15);
+		p1 = _mm_srai_epi32(_mm_add_epi32(_mm_unpackhi_epi16(lo, hi), round), 15);
+
+		_mm_storeu_si128((__m128i *)d, _mm_packs_epi32(p0, p1));
+
+		g0 = _mm_add_epi32(g0, inc);
+		g1 = _mm_add_epi32(g1, inc);
+
+		s += 16;
+		d += 16;
+		gain += step * 4;
+	}
+
+	if (size != 0)
+		scale_samples_scalar(s, d, size, gain, step);
+}
+
+#endif
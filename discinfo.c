@@ -0,0 +1,164 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+/* Discs that have been seen before, and where playing got to. The file is
+ * a table of fixed size records, and a disc can only be in the one slot
+ * that its FreeDB disc ID hashes to, so a lookup is a single read. A new
+ * disc replaces whatever was in its slot. */
+#define DISC_INFO_DIR  "ENVARC:PlayCDDA"
+#define DISC_INFO_FILE "ENVARC:PlayCDDA/Discs"
+
+#define DISC_INFO_MAGIC   0x50434449 /* 'PCDI' */
+#define DISC_INFO_VERSION 2
+#define DISC_INFO_SLOTS   256
+
+struct DiscInfoHeader {
+	ULONG dih_Magic;
+	ULONG dih_Version;
+	ULONG dih_NumSlots;
+	ULONG dih_SlotSize;
+};
+
+/* The low byte of a disc ID is the track count, so it is mixed first */
+static ULONG get_disc_slot(ULONG discid) {
+	return ((discid * 0x9E3779B1) >> 16) % DISC_INFO_SLOTS;
+}
+
+static BOOL check_header(BPTR file) {
+	struct DiscInfoHeader dih;
+
+	return (Read(file, &dih, sizeof(dih)) == sizeof(dih) &&
+		dih.dih_Magic == DISC_INFO_MAGIC && dih.dih_Version == DISC_INFO_VERSION &&
+		dih.dih_NumSlots == DISC_INFO_SLOTS && dih.dih_SlotSize == sizeof(struct DiscInfo));
+}
+
+/* Writes a header and an empty table */
+static BPTR create_disc_info_file(void) {
+	struct DiscInfoHeader dih;
+	struct DiscInfo       empty;
+	BPTR                  file, lock;
+	int                   i;
+
+	lock = Lock((CONST_STRPTR)DISC_INFO_DIR, ACCESS_READ);
+	if (lock == ZERO)
+		lock = CreateDir((CONST_STRPTR)DISC_INFO_DIR);
+
+	if (lock == ZERO)
+		return ZERO;
+
+	UnLock(lock);
+
+	file = Open((CONST_STRPTR)DISC_INFO_FILE, MODE_NEWFILE);
+	if (file == ZERO)
+		return ZERO;
+
+	dih.dih_Magic    = DISC_INFO_MAGIC;
+	dih.dih_Version  = DISC_INFO_VERSION;
+	dih.dih_NumSlots = DISC_INFO_SLOTS;
+	dih.dih_SlotSize = sizeof(struct DiscInfo);
+
+	memset(&empty, 0, sizeof(empty));
+
+	if (Write(file, &dih, sizeof(dih)) != sizeof(dih))
+		goto error;
+
+	for (i = 0; i < DISC_INFO_SLOTS; i++) {
+		if (Write(file, &empty, sizeof(empty)) != sizeof(empty))
+			goto error;
+	}
+
+	return file;
+
+error:
+	Close(file);
+	DeleteFile((CONST_STRPTR)DISC_INFO_FILE);
+	return ZERO;
+}
+
+/* Looks up a disc by the TOC read from it. Only a record with the same
+ * TOC is taken, as different discs can have the same disc ID. Returns
+ * FALSE if it hasn't been seen, or its slot has been taken by another
+ * disc since. */
+BOOL find_disc_info(const struct PlayCDDATOC *toc, struct DiscInfo *di) {
+	ULONG discid, slot;
+	BPTR  file;
+	BOOL  found = FALSE;
+
+	if (toc->toc_NumTracks <= 0 || toc->toc_NumTracks > MAX_TRACKS)
+		return FALSE;
+
+	file = Open((CONST_STRPTR)DISC_INFO_FILE, MODE_OLDFILE);
+	if (file == ZERO)
+		return FALSE;
+
+	discid = get_freedb_id(toc);
+	slot   = get_disc_slot(discid);
+
+	if (check_header(file) &&
+		Seek(file, slot * sizeof(*di), OFFSET_CURRENT) != -1 &&
+		Read(file, di, sizeof(*di)) == sizeof(*di) &&
+		di->di_DiscID == discid && memcmp(&di->di_TOC, toc, sizeof(*toc)) == 0)
+	{
+		found = TRUE;
+	}
+
+	Close(file);
+
+	return found;
+}
+
+/* Puts a disc in its slot, creating the file if it isn't there yet */
+void store_disc_info(const struct DiscInfo *di) {
+	int   tracks = di->di_TOC.toc_NumTracks;
+	ULONG slot;
+	BPTR  file;
+
+	if (tracks <= 0 || tracks > MAX_TRACKS)
+		return;
+
+	slot = get_disc_slot(di->di_DiscID);
+
+	file = Open((CONST_STRPTR)DISC_INFO_FILE, MODE_OLDFILE);
+	if (file != ZERO && !check_header(file)) {
+		Close(file);
+		file = ZERO;
+	}
+
+	if (file == ZERO)
+		file = create_disc_info_file();
+
+	if (file == ZERO)
+		return;
+
+	if (Seek(file, sizeof(struct DiscInfoHeader) + slot * sizeof(*di), OFFSET_BEGINNING) != -1)
+		Write(file, di, sizeof(*di));
+
+	Close(file);
+}
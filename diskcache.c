@@ -0,0 +1,466 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+#include <stdio.h>
+
+/* Sectors per chunk. Only whole chunks are stored, so reads that are
+ * meant to be stored end on a chunk boundary. */
+#define CHUNK_FRAMES 16
+#define CHUNK_SIZE   (CHUNK_FRAMES * CDDA_FRAME_SIZE)
+
+#define DISK_CACHE_MAGIC   0x50434443 /* 'PCDC' */
+#define DISK_CACHE_VERSION 1
+
+/* Bytes to add to the current file before checking the size limit again */
+#define EVICT_INTERVAL (16*1024*1024)
+
+struct DiskCacheHeader {
+	ULONG dh_Magic;
+	ULONG dh_Version;
+	ULONG dh_ChunkFrames;
+	ULONG dh_NumChunks;
+	ULONG dh_Fingerprint;
+	ULONG dh_NumTracks;
+	ULONG dh_Addr[MAX_TRACKS + 1];
+};
+
+/* FNV-1a over the track types and addresses, byte order independent */
+static ULONG disc_fingerprint(const struct PlayCDDATOC *toc) {
+	ULONG hash = 0x811C9DC5;
+	ULONG addr;
+	int   i, j;
+
+	hash = (hash ^ toc->toc_NumTracks) * 0x01000193;
+
+	for (i = 0; i <= toc->toc_NumTracks; i++) {
+		hash = (hash ^ toc->toc_Type[i]) * 0x01000193;
+
+		addr = toc->toc_Addr[i];
+		for (j = 24; j >= 0; j -= 8)
+			hash = (hash ^ ((addr >> j) & 0xFF)) * 0x01000193;
+	}
+
+	return hash;
+}
+
+/* The part of a chunk that is audio. Chunks are cut short where an audio
+ * run starts or ends. */
+static BOOL get_chunk_audio(const struct DiskCache *dc, ULONG chunk, LONG *start, LONG *end) {
+	LONG chunk_start = chunk * CHUNK_FRAMES;
+	LONG chunk_end   = chunk_start + CHUNK_FRAMES;
+
+	if (!get_audio_run(&dc->dc_TOC, chunk_start, start, end) || *start >= chunk_end)
+		return FALSE;
+
+	if (*end > chunk_end)
+		*end = chunk_end;
+
+	return TRUE;
+}
+
+static void get_cache_path(const struct DiskCache *dc, const char *name, char *path, int path_size) {
+	strlcpy(path, dc->dc_Dir, path_size);
+	AddPart((STRPTR)path, (CONST_STRPTR)name, path_size);
+}
+
+static BOOL is_cache_file(const char *name) {
+	size_t len = strlen(name);
+
+	return (len == 13 && strcmp(&name[8], ".cdda") == 0);
+}
+
+/* Deletes the least recently used files other than the current one until
+ * the directory is below the size limit. Files are touched when opened
+ * and written to while in use, so the date tells when they were used. */
+static void evict_disk_cache(struct DiskCache *dc) {
+	struct FileInfoBlock *fib;
+	struct DateStamp      oldest_date;
+	char                  oldest[16];
+	char                  path[256];
+	UQUAD                 total;
+	BPTR                  lock;
+
+	dc->dc_Written = 0;
+
+	fib = AllocDosObject(DOS_FIB, NULL);
+	if (fib == NULL)
+		return;
+
+	for (;;) {
+		lock = Lock((CONST_STRPTR)dc->dc_Dir, ACCESS_READ);
+		if (lock == ZERO)
+			break;
+
+		total     = 0;
+		oldest[0] = '\0';
+
+		if (Examine(lock, fib)) {
+			while (ExNext(lock, fib)) {
+				if (fib->fib_DirEntryType >= 0 || !is_cache_file((const char *)fib->fib_FileName))
+					continue;
+
+				total += (ULONG)fib->fib_Size;
+
+				if (strcmp((const char *)fib->fib_FileName, dc->dc_Name) == 0)
+					continue;
+
+				if (oldest[0] == '\0' || CompareDates(&fib->fib_Date, &oldest_date) > 0) {
+					oldest_date = fib->fib_Date;
+					strlcpy(oldest, (const char *)fib->fib_FileName, sizeof(oldest));
+				}
+			}
+		}
+
+		UnLock(lock);
+
+		if (total <= dc->dc_MaxSize || oldest[0] == '\0')
+			break;
+
+		get_cache_path(dc, oldest, path, sizeof(path));
+		if (!DeleteFile((CONST_STRPTR)path))
+			break;
+	}
+
+	FreeDosObject(DOS_FIB, fib);
+}
+
+static BOOL read_cache_file(struct DiskCache *dc, const struct DiskCacheHeader *dh) {
+	struct DiskCacheHeader header;
+	ULONG                  index_size = dc->dc_NumChunks * sizeof(ULONG);
+	LONG                   size, start, end;
+	ULONG                  i;
+
+	if (Read(dc->dc_File, &header, sizeof(header)) != sizeof(header) ||
+		memcmp(&header, dh, sizeof(header)) != 0)
+	{
+		return FALSE;
+	}
+
+	if (Read(dc->dc_File, dc->dc_Index, index_size) != index_size)
+		return FALSE;
+
+	Seek(dc->dc_File, 0, OFFSET_END);
+	size = Seek(dc->dc_File, 0, OFFSET_CURRENT);
+	if (size < 0)
+		return FALSE;
+
+	dc->dc_FileSize = size;
+
+	/* Forget chunks that didn't make it to the file before a crash */
+	for (i = 0; i < dc->dc_NumChunks; i++) {
+		if (dc->dc_Index[i] == 0)
+			continue;
+
+		if (!get_chunk_audio(dc, i, &start, &end) ||
+			dc->dc_Index[i] + (start - i * CHUNK_FRAMES) * CDDA_FRAME_SIZE < sizeof(header) + index_size ||
+			dc->dc_Index[i] + (end - i * CHUNK_FRAMES) * CDDA_FRAME_SIZE > dc->dc_FileSize)
+		{
+			dc->dc_Index[i] = 0;
+		}
+	}
+
+	return TRUE;
+}
+
+static BOOL create_cache_file(struct DiskCache *dc, const char *path, const struct DiskCacheHeader *dh) {
+	ULONG index_size = dc->dc_NumChunks * sizeof(ULONG);
+
+	if (dc->dc_File != ZERO)
+		Close(dc->dc_File);
+
+	dc->dc_File = Open((CONST_STRPTR)path, MODE_NEWFILE);
+	if (dc->dc_File == ZERO)
+		return FALSE;
+
+	memset(dc->dc_Index, 0, index_size);
+
+	if (Write(dc->dc_File, dh, sizeof(*dh)) != sizeof(*dh) ||
+		Write(dc->dc_File, dc->dc_Index, index_size) != index_size)
+	{
+		return FALSE;
+	}
+
+	dc->dc_FileSize = sizeof(*dh) + index_size;
+
+	return TRUE;
+}
+
+/* Opens the file for the disc, creating it if needed. NULL if there is
+ * no sector cache directory or no audio on the disc. */
+struct DiskCache *open_disk_cache(struct PlayCDDAData *pcd, const struct PlayCDDATOC *toc) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	struct DiskCache          *dc;
+	struct DiskCacheHeader     dh;
+	struct DateStamp           ds;
+	char                       path[256];
+	LONG                       start, end;
+	BPTR                       lock;
+	int                        i;
+
+	if (pcpd->pcpd_DiskCacheDir[0] == '\0' || pcpd->pcpd_DiskCacheSize == 0)
+		return NULL;
+
+	if (toc->toc_NumTracks == 0 || toc->toc_NumTracks > MAX_TRACKS ||
+		!get_audio_run(toc, 0, &start, &end))
+	{
+		return NULL;
+	}
+
+	lock = Lock((CONST_STRPTR)pcpd->pcpd_DiskCacheDir, ACCESS_READ);
+	if (lock == ZERO)
+		lock = CreateDir((CONST_STRPTR)pcpd->pcpd_DiskCacheDir);
+
+	if (lock == ZERO)
+		return NULL;
+
+	UnLock(lock);
+
+	dc = alloc_shared_mem(sizeof(*dc));
+	if (dc == NULL)
+		return NULL;
+
+	memset(dc, 0, sizeof(*dc));
+
+	dc->dc_Dir       = pcpd->pcpd_DiskCacheDir;
+	dc->dc_MaxSize   = (UQUAD)pcpd->pcpd_DiskCacheSize * 1024 * 1024;
+	dc->dc_TOC       = *toc;
+	dc->dc_NumChunks = (toc->toc_Addr[toc->toc_NumTracks] + CHUNK_FRAMES - 1) / CHUNK_FRAMES;
+
+	dc->dc_Index = alloc_shared_mem(dc->dc_NumChunks * sizeof(ULONG));
+	if (dc->dc_Index == NULL)
+		goto fail;
+
+	memset(&dh, 0, sizeof(dh));
+
+	dh.dh_Magic       = DISK_CACHE_MAGIC;
+	dh.dh_Version     = DISK_CACHE_VERSION;
+	dh.dh_ChunkFrames = CHUNK_FRAMES;
+	dh.dh_NumChunks   = dc->dc_NumChunks;
+	dh.dh_Fingerprint = disc_fingerprint(toc);
+	dh.dh_NumTracks   = toc->toc_NumTracks;
+
+	for (i = 0; i <= toc->toc_NumTracks; i++)
+		dh.dh_Addr[i] = toc->toc_Addr[i];
+
+	snprintf(dc->dc_Name, sizeof(dc->dc_Name), "%08lx.cdda", (unsigned long)dh.dh_Fingerprint);
+	get_cache_path(dc, dc->dc_Name, path, sizeof(path));
+
+	/* Most recently used */
+	SetFileDate((CONST_STRPTR)path, DateStamp(&ds));
+
+	dc->dc_File = Open((CONST_STRPTR)path, MODE_READWRITE);
+	if (dc->dc_File == ZERO)
+		goto fail;
+
+	/* Start over if it's from another version or the fingerprints clash */
+	if (!read_cache_file(dc, &dh) && !create_cache_file(dc, path, &dh))
+		goto fail;
+
+	evict_disk_cache(dc);
+
+	return dc;
+
+fail:
+	close_disk_cache(dc);
+	return NULL;
+}
+
+void close_disk_cache(struct DiskCache *dc) {
+	if (dc != NULL) {
+		if (dc->dc_File != ZERO)
+			Close(dc->dc_File);
+
+		if (dc->dc_Index != NULL)
+			free_shared_mem(dc->dc_Index, dc->dc_NumChunks * sizeof(ULONG));
+
+		free_shared_mem(dc, sizeof(*dc));
+	}
+}
+
+/* Reads the sectors from addr on that are in the file, up to frames of
+ * them, with a single seek. Returns 0 if the sector at addr isn't cached. */
+int read_disk_cache(struct DiskCache *dc, LONG addr, int frames, UWORD *buffer) {
+	ULONG chunk, offset;
+	LONG  start, end;
+	int   count;
+
+	if (dc == NULL || addr < 0)
+		return 0;
+
+	chunk = addr / CHUNK_FRAMES;
+	if (chunk >= dc->dc_NumChunks || dc->dc_Index[chunk] == 0)
+		return 0;
+
+	if (!get_audio_run(&dc->dc_TOC, addr, &start, &end) || start != addr)
+		return 0;
+
+	offset = dc->dc_Index[chunk] + (addr - chunk * CHUNK_FRAMES) * CDDA_FRAME_SIZE;
+	count  = (chunk + 1) * CHUNK_FRAMES - addr;
+
+	/* Chunks that were stored together follow each other in the file */
+	while (count < frames && chunk + 1 < dc->dc_NumChunks &&
+		dc->dc_Index[chunk + 1] == dc->dc_Index[chunk] + CHUNK_SIZE)
+	{
+		chunk++;
+		count += CHUNK_FRAMES;
+	}
+
+	if (count > frames)
+		count = frames;
+
+	/* Chunks at the end of an audio run are cut short */
+	if (count > end - addr)
+		count = end - addr;
+
+	if (Seek(dc->dc_File, offset, OFFSET_BEGINNING) == -1)
+		return 0;
+
+	if (Read(dc->dc_File, buffer, count * CDDA_FRAME_SIZE) != count * CDDA_FRAME_SIZE)
+		return 0;
+
+	return count;
+}
+
+/* Sectors to read from the drive at addr, which isn't cached, so that the
+ * read stops before the next cached chunk and ends on a chunk boundary */
+int disk_cache_miss(const struct DiskCache *dc, LONG addr, int frames) {
+	ULONG chunk;
+	LONG  end = addr + frames;
+
+	if (dc == NULL || dc->dc_Full)
+		return frames;
+
+	for (chunk = addr / CHUNK_FRAMES + 1; chunk < dc->dc_NumChunks && chunk * CHUNK_FRAMES < end; chunk++) {
+		if (dc->dc_Index[chunk] != 0) {
+			end = chunk * CHUNK_FRAMES;
+			break;
+		}
+	}
+
+	if (end - (end % CHUNK_FRAMES) > addr)
+		end -= end % CHUNK_FRAMES;
+
+	return end - addr;
+}
+
+/* Appends the chunks from first to last to the file, then points the
+ * index at them. Returns the sectors added. */
+static int append_chunks(struct DiskCache *dc, ULONG first, ULONG last, LONG start, LONG end,
+	const UBYTE *data)
+{
+	ULONG size = (end - start) * CDDA_FRAME_SIZE;
+	ULONG base, chunk;
+
+	if ((UQUAD)dc->dc_FileSize + size > dc->dc_MaxSize)
+		goto full;
+
+	if (Seek(dc->dc_File, dc->dc_FileSize, OFFSET_BEGINNING) == -1 ||
+		Write(dc->dc_File, data, size) != size)
+	{
+		goto full;
+	}
+
+	/* Where the first chunk would start if it weren't cut short */
+	base = dc->dc_FileSize - (start - first * CHUNK_FRAMES) * CDDA_FRAME_SIZE;
+
+	for (chunk = first; chunk <= last; chunk++)
+		dc->dc_Index[chunk] = base + (chunk - first) * CHUNK_SIZE;
+
+	dc->dc_FileSize += size;
+	dc->dc_Written  += size;
+
+	if (Seek(dc->dc_File, sizeof(struct DiskCacheHeader) + first * sizeof(ULONG), OFFSET_BEGINNING) == -1 ||
+		Write(dc->dc_File, &dc->dc_Index[first], (last - first + 1) * sizeof(ULONG)) != (last - first + 1) * sizeof(ULONG))
+	{
+		goto full;
+	}
+
+	return end - start;
+
+full:
+	/* Out of space, keep using what's there */
+	dc->dc_Full = TRUE;
+	return 0;
+}
+
+/* Stores the chunks that lie completely within the sectors just read from
+ * the drive. Returns the sectors added. */
+int write_disk_cache(struct DiskCache *dc, LONG addr, int frames, const UWORD *buffer) {
+	const UBYTE *data = (const UBYTE *)buffer;
+	LONG         run_start, run_end, end;
+	LONG         chunk_start, chunk_end;
+	LONG         start = 0, stop = 0;
+	ULONG        chunk, first = 0;
+	BOOL         batch = FALSE;
+	int          stored = 0;
+
+	if (dc == NULL || dc->dc_Full || frames <= 0)
+		return 0;
+
+	if (!get_audio_run(&dc->dc_TOC, addr, &run_start, &run_end) || run_start != addr)
+		return 0;
+
+	end = addr + frames;
+	if (end > run_end)
+		end = run_end;
+
+	/* Runs of new chunks go to the file with one write each */
+	for (chunk = addr / CHUNK_FRAMES; chunk < dc->dc_NumChunks && !dc->dc_Full; chunk++) {
+		BOOL whole = get_chunk_audio(dc, chunk, &chunk_start, &chunk_end) &&
+			chunk_start >= addr && chunk_end <= end && dc->dc_Index[chunk] == 0;
+
+		if (whole) {
+			if (!batch) {
+				batch = TRUE;
+				first = chunk;
+				start = chunk_start;
+			}
+
+			stop = chunk_end;
+			continue;
+		}
+
+		if (batch) {
+			batch   = FALSE;
+			stored += append_chunks(dc, first, chunk - 1, start, stop, data + (start - addr) * CDDA_FRAME_SIZE);
+		}
+
+		if ((chunk + 1) * CHUNK_FRAMES >= end)
+			break;
+	}
+
+	if (batch)
+		stored += append_chunks(dc, first, chunk - 1, start, stop, data + (start - addr) * CDDA_FRAME_SIZE);
+
+	if (dc->dc_Written >= EVICT_INTERVAL)
+		evict_disk_cache(dc);
+
+	return stored;
+}
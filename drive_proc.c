@@ -0,0 +1,349 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+/* Reads the TOC and takes the rest from the disc info file if the disc
+ * has been seen before, or adds it */
+static BOOL get_disc_info(struct PlayCDDAData *pcd, struct DiscInfo *di) {
+	struct PlayCDDATOC toc;
+
+	if (!read_toc(pcd, &toc)) {
+		memset(di, 0, sizeof(*di));
+		di->di_LastAddr = -1;
+		return FALSE;
+	}
+
+	if (find_disc_info(&toc, di))
+		return TRUE;
+
+	memset(di, 0, sizeof(*di));
+	di->di_DiscID   = get_freedb_id(&toc);
+	di->di_TOC      = toc;
+	di->di_LastAddr = -1;
+
+	store_disc_info(di);
+
+	return TRUE;
+}
+
+/* The titles are looked up as well, if there's a FreeDB database */
+static BOOL load_disc(struct PlayCDDAData *pcd, struct PlayCDDADriveData *pcdd) {
+	BOOL result;
+
+	result = get_disc_info(pcd, &pcdd->pcdd_Disc);
+
+	pcdd->pcdd_Titles.dt_NumTracks = 0;
+	if (result && pcd->pcd_FreeDB[0] != '\0')
+		find_disc_titles(pcd->pcd_FreeDB, &pcdd->pcdd_Disc.di_TOC, &pcdd->pcdd_Titles);
+
+	return result;
+}
+
+static BOOL read_disc(struct PlayCDDAData *pcd, struct PlayCDDADriveData *pcdd) {
+	/* Taken first, so that a change while the TOC is being read isn't
+	 * missed */
+	pcdd->pcdd_HaveChangeCount = get_disc_change_count(pcd, &pcdd->pcdd_ChangeCount);
+
+	return load_disc(pcd, pcdd);
+}
+
+/* Reads the TOC again only if the disc may be different from the one in
+ * pcdd_Disc. A change count that hasn't moved costs no SCSI command. A
+ * drive without one gets a short READ TOC of the lead-out and track count
+ * instead. Returns TRUE if pcdd_Disc has changed. */
+static BOOL check_disc(struct PlayCDDAData *pcd, struct PlayCDDADriveData *pcdd) {
+	const struct PlayCDDATOC *toc = &pcdd->pcdd_Disc.di_TOC;
+	struct PlayCDDATOC        old;
+	ULONG                     count;
+	LONG                      leadout;
+	int                       tracks;
+
+	if (pcdd->pcdd_HaveChangeCount && get_disc_change_count(pcd, &count) &&
+		count == pcdd->pcdd_ChangeCount)
+	{
+		return FALSE;
+	}
+
+	pcdd->pcdd_HaveChangeCount = get_disc_change_count(pcd, &pcdd->pcdd_ChangeCount);
+
+	if (!pcdd->pcdd_HaveChangeCount) {
+		read_disc_id(pcd, &tracks, &leadout);
+		if (tracks == toc->toc_NumTracks && leadout == (LONG)toc->toc_Addr[toc->toc_NumTracks])
+			return FALSE;
+	}
+
+	old = *toc;
+	load_disc(pcd, pcdd);
+
+	return (memcmp(&old, toc, sizeof(old)) != 0);
+}
+
+/* Opens drives and reads TOCs, which can take seconds with a slow or empty
+ * drive, so that the GUI only has to wait for the reply. Once started it
+ * owns the drive, and it closes the drive when it quits. */
+static int drive_proc_entry(void) {
+	struct Process            *me;
+	struct MsgPort            *myport;
+	struct PlayCDDAData       *pcd;
+	struct PlayCDDADriveData  *pcdd;
+	struct PlayCDDAMsg        *pcm;
+	BOOL                       done = FALSE;
+
+	me     = (struct Process *)FindTask(NULL);
+	myport = &me->pr_MsgPort;
+
+	while (!done) {
+		WaitPort(myport);
+		pcm = (struct PlayCDDAMsg *)GetMsg(myport);
+
+		pcd  = pcm->pcm_GlobalData;
+		pcdd = &pcd->pcd_DriveData;
+
+		switch (pcm->pcm_Command) {
+			case PCC_STARTUP:
+				pcm->pcm_Result = TRUE;
+				break;
+
+			case PCC_OPENDRIVE:
+				pcm->pcm_Result = open_cdrom_drive(pcd, (struct CDROMDrive *)pcm->pcm_Arg1);
+				break;
+
+			case PCC_READTOC:
+				pcm->pcm_Result = read_disc(pcd, pcdd);
+				break;
+
+			case PCC_CHECKDISC:
+				pcm->pcm_Result = check_disc(pcd, pcdd);
+				break;
+
+			case PCC_DIE:
+				close_cdrom_drive(pcd);
+				pcm->pcm_Result = TRUE;
+				done = TRUE;
+				break;
+
+			default:
+				pcm->pcm_Result = FALSE;
+				break;
+		}
+
+		/* Our exit breaks the Forbid(), so the program can't be unloaded
+		 * under us once the reply is seen */
+		if (done)
+			Forbid();
+
+		ReplyMsg(&pcm->pcm_Msg);
+	}
+
+	return RETURN_OK;
+}
+
+/* Takes back the command in flight, waiting for it if asked to. Returns
+ * FALSE if there's none, or it isn't done. */
+static BOOL get_drive_message(struct PlayCDDADriveData *pcdd, BOOL wait) {
+	if (!pcdd->pcdd_Busy)
+		return FALSE;
+
+	if (wait)
+		WaitPort(pcdd->pcdd_ReplyPort);
+
+	if (GetMsg(pcdd->pcdd_ReplyPort) == NULL)
+		return FALSE;
+
+	pcdd->pcdd_Busy = FALSE;
+
+	return TRUE;
+}
+
+static void put_drive_message(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg) {
+	struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+	struct PlayCDDAMsg       *pcm  = &pcdd->pcdd_CmdMsg;
+
+	pcm->pcm_Msg.mn_Node.ln_Type = NT_MESSAGE;
+	pcm->pcm_Msg.mn_ReplyPort    = pcdd->pcdd_ReplyPort;
+	pcm->pcm_Msg.mn_Length       = sizeof(*pcm);
+
+	pcm->pcm_GlobalData = pcd;
+	pcm->pcm_Command    = command;
+	pcm->pcm_Arg1       = arg;
+	pcm->pcm_Result     = FALSE;
+
+	pcdd->pcdd_Busy = TRUE;
+
+	PutMsg(&pcdd->pcdd_Process->pr_MsgPort, &pcm->pcm_Msg);
+}
+
+/* Sends a command and waits for it, after the one in flight if there is
+ * one. Anything waiting to be sent is dropped. */
+BOOL do_drive_command(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg) {
+	struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+
+	if (pcdd->pcdd_Process == NULL)
+		return FALSE;
+
+	get_drive_message(pcdd, TRUE);
+
+	pcdd->pcdd_Pending = PCC_INVALID;
+
+	put_drive_message(pcd, command, arg);
+	get_drive_message(pcdd, TRUE);
+
+	return pcdd->pcdd_CmdMsg.pcm_Result;
+}
+
+/* Sends a command without waiting for it. If one is already in flight it's
+ * sent once that one is back, replacing anything else that was waiting.
+ * A TOC read is left out if a drive is about to be opened, as that is
+ * followed by one anyway, and a disc check if either is waiting. */
+void send_drive_command(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg) {
+	struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+
+	if (pcdd->pcdd_Process == NULL)
+		return;
+
+	if (command == PCC_OPENDRIVE) {
+		pcdd->pcdd_SwitchStart = get_time_us(pcd);
+		pcdd->pcdd_Switching   = TRUE;
+	}
+
+	if (!pcdd->pcdd_Busy) {
+		put_drive_message(pcd, command, arg);
+		return;
+	}
+
+	if (pcdd->pcdd_Pending == PCC_OPENDRIVE && command != PCC_OPENDRIVE)
+		return;
+
+	if (pcdd->pcdd_Pending == PCC_READTOC && command == PCC_CHECKDISC)
+		return;
+
+	pcdd->pcdd_Pending    = command;
+	pcdd->pcdd_PendingArg = arg;
+}
+
+/* The command that has finished, if any, and sends the one waiting. The
+ * result is skipped if that opens another drive. pcdd_Disc holds the disc
+ * after a PCC_READTOC, or a PCC_CHECKDISC that returned TRUE. */
+BOOL get_drive_reply(struct PlayCDDAData *pcd, pcm_command_t *command, BOOL *result) {
+	struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+	pcm_command_t             pending;
+
+	if (!get_drive_message(pcdd, FALSE))
+		return FALSE;
+
+	*command = pcdd->pcdd_CmdMsg.pcm_Command;
+	*result  = pcdd->pcdd_CmdMsg.pcm_Result;
+
+	pending = pcdd->pcdd_Pending;
+	if (pending != PCC_INVALID) {
+		pcdd->pcdd_Pending = PCC_INVALID;
+		put_drive_message(pcd, pending, pcdd->pcdd_PendingArg);
+
+		if (pending == PCC_OPENDRIVE)
+			return FALSE;
+	}
+
+	/* A switch is done once the new disc has been read, or the drive
+	 * couldn't be opened */
+	if (pcdd->pcdd_Switching && (*command == PCC_READTOC || !*result)) {
+		pcd->pcd_SwitchTime = get_time_us(pcd) - pcdd->pcdd_SwitchStart;
+		pcdd->pcdd_Switching = FALSE;
+	}
+
+	return TRUE;
+}
+
+/* TRUE while the drive is being opened or a TOC read. Disc checks don't
+ * count, as they are mostly over before anything could be shown. */
+BOOL is_drive_reading(const struct PlayCDDAData *pcd) {
+	const struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+
+	if (!pcdd->pcdd_Busy)
+		return FALSE;
+
+	return (pcdd->pcdd_CmdMsg.pcm_Command != PCC_CHECKDISC ||
+		(pcdd->pcdd_Pending != PCC_INVALID && pcdd->pcdd_Pending != PCC_CHECKDISC));
+}
+
+ULONG get_drive_signal(const struct PlayCDDAData *pcd) {
+	const struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+
+	if (pcdd->pcdd_Process == NULL)
+		return 0;
+
+	return (ULONG)1 << pcdd->pcdd_ReplyPort->mp_SigBit;
+}
+
+BOOL start_drive_proc(struct PlayCDDAData *pcd) {
+	struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+
+	pcdd->pcdd_ReplyPort = create_msgport();
+	if (pcdd->pcdd_ReplyPort == NULL)
+		return FALSE;
+
+	pcdd->pcdd_Pending = PCC_INVALID;
+
+	pcdd->pcdd_Process = CreateNewProcTags(
+		NP_Name,        "PlayCDDA Drive Process",
+		NP_Entry,       &drive_proc_entry,
+		NP_StackSize,   8192,
+		NP_Priority,    DRIVE_PROC_PRI,
+		NP_CurrentDir,  0,
+		NP_Path,        0,
+		NP_CopyVars,    FALSE,
+		NP_Input,       0,
+		NP_Output,      0,
+		NP_Error,       0,
+		NP_CloseInput,  FALSE,
+		NP_CloseOutput, FALSE,
+		NP_CloseError,  FALSE,
+		TAG_END);
+	if (pcdd->pcdd_Process == NULL) {
+		delete_msgport(pcdd->pcdd_ReplyPort);
+		pcdd->pcdd_ReplyPort = NULL;
+		return FALSE;
+	}
+
+	return do_drive_command(pcd, PCC_STARTUP, 0);
+}
+
+/* Closes the drive as well */
+void stop_drive_proc(struct PlayCDDAData *pcd) {
+	struct PlayCDDADriveData *pcdd = &pcd->pcd_DriveData;
+
+	if (pcdd->pcdd_Process != NULL) {
+		do_drive_command(pcd, PCC_DIE, 0);
+		pcdd->pcdd_Process = NULL;
+	}
+
+	if (pcdd->pcdd_ReplyPort != NULL) {
+		delete_msgport(pcdd->pcdd_ReplyPort);
+		pcdd->pcdd_ReplyPort = NULL;
+	}
+}
@@ -0,0 +1,192 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+#include "freedb.h"
+
+/* The FreeDB disc ID, from the track start times in seconds (with the 150
+ * sector pregap) and the length of the disc */
+ULONG get_freedb_id(const struct PlayCDDATOC *toc) {
+	ULONG sum = 0, secs;
+	int   tracks = toc->toc_NumTracks;
+	int   i;
+
+	for (i = 0; i < tracks; i++) {
+		for (secs = (toc->toc_Addr[i] + 150) / CDDA_FRAMES_PER_SEC; secs != 0; secs /= 10)
+			sum += secs % 10;
+	}
+
+	secs = (toc->toc_Addr[tracks] + 150) / CDDA_FRAMES_PER_SEC -
+		(toc->toc_Addr[0] + 150) / CDDA_FRAMES_PER_SEC;
+
+	return ((sum % 0xFF) << 24) | ((secs & 0xFFFF) << 8) | (tracks & 0xFF);
+}
+
+BOOL open_freedb(struct FreeDB *fdb, const char *path) {
+	UBYTE header[FREEDB_HEADER_SIZE];
+
+	fdb->fdb_File = Open((CONST_STRPTR)path, MODE_OLDFILE);
+	if (fdb->fdb_File == ZERO)
+		return FALSE;
+
+	if (Read(fdb->fdb_File, header, sizeof(header)) != sizeof(header) ||
+		get_be32(&header[0]) != FREEDB_MAGIC || get_be32(&header[4]) != FREEDB_VERSION)
+	{
+		goto error;
+	}
+
+	fdb->fdb_IndexOffset = get_be32(&header[8]);
+	fdb->fdb_IndexBits   = get_be32(&header[12]);
+	fdb->fdb_NumEntries  = get_be32(&header[16]);
+
+	if (fdb->fdb_IndexBits < 1 || fdb->fdb_IndexBits > FREEDB_MAX_INDEX_BITS)
+		goto error;
+
+	return TRUE;
+
+error:
+	Close(fdb->fdb_File);
+	fdb->fdb_File = ZERO;
+	return FALSE;
+}
+
+void close_freedb(struct FreeDB *fdb) {
+	if (fdb->fdb_File != ZERO) {
+		Close(fdb->fdb_File);
+		fdb->fdb_File = ZERO;
+	}
+}
+
+/* Reads the record of a disc, cut short to size. Takes one read of the
+ * index and one of the record. Returns the bytes read, -1 if the disc
+ * isn't there. */
+LONG read_freedb_record(struct FreeDB *fdb, ULONG discid, UBYTE *buffer, LONG size) {
+	UBYTE        index[FREEDB_PROBE_SLOTS * FREEDB_ENTRY_SIZE];
+	const UBYTE *entry;
+	ULONG        slot;
+	LONG         length;
+	int          i;
+
+	slot = get_freedb_slot(discid, fdb->fdb_IndexBits);
+
+	if (Seek(fdb->fdb_File, fdb->fdb_IndexOffset + slot * FREEDB_ENTRY_SIZE, OFFSET_BEGINNING) == -1 ||
+		Read(fdb->fdb_File, index, sizeof(index)) != sizeof(index))
+	{
+		return -1;
+	}
+
+	/* Nothing is ever removed, so a free slot ends the search */
+	for (i = 0; i < FREEDB_PROBE_SLOTS; i++) {
+		entry  = &index[i * FREEDB_ENTRY_SIZE];
+		length = get_be32(&entry[8]);
+
+		if (length == 0)
+			return -1;
+
+		if (get_be32(&entry[0]) == discid)
+			break;
+	}
+
+	if (i == FREEDB_PROBE_SLOTS)
+		return -1;
+
+	if (length > size)
+		length = size;
+
+	if (Seek(fdb->fdb_File, get_be32(&entry[4]), OFFSET_BEGINNING) == -1 ||
+		Read(fdb->fdb_File, buffer, length) != length)
+	{
+		return -1;
+	}
+
+	return length;
+}
+
+/* Looks up the titles of a disc by its FreeDB disc ID. A record with
+ * another track count is a different disc with the same ID. */
+BOOL find_disc_titles(const char *path, const struct PlayCDDATOC *toc, struct DiscTitles *dt) {
+	struct FreeDB fdb;
+	LONG          length;
+	int           tracks, pos, i;
+
+	dt->dt_NumTracks = 0;
+
+	if (toc->toc_NumTracks == 0 || !open_freedb(&fdb, path))
+		return FALSE;
+
+	length = read_freedb_record(&fdb, get_freedb_id(toc), (UBYTE *)dt->dt_Text, sizeof(dt->dt_Text));
+
+	close_freedb(&fdb);
+
+	if (length < 2)
+		return FALSE;
+
+	tracks = (UBYTE)dt->dt_Text[0];
+	if (tracks != toc->toc_NumTracks)
+		return FALSE;
+
+	/* The track count is dropped, which leaves room for a NUL in case
+	 * the record was cut short */
+	memmove(dt->dt_Text, dt->dt_Text + 1, length - 1);
+	dt->dt_Text[length - 1] = '\0';
+
+	pos = strlen(dt->dt_Text) + 1;
+	for (i = 0; i < tracks; i++) {
+		if (pos >= length)
+			pos = length - 1;
+
+		dt->dt_Track[i] = pos;
+		pos += strlen(dt->dt_Text + pos) + 1;
+	}
+
+	dt->dt_NumTracks = tracks;
+
+	return TRUE;
+}
+
+/* NULL if there's none */
+const char *get_disc_title(const struct DiscTitles *dt) {
+	if (dt->dt_NumTracks == 0 || dt->dt_Text[0] == '\0')
+		return NULL;
+
+	return dt->dt_Text;
+}
+
+/* NULL if there's none */
+const char *get_track_title(const struct DiscTitles *dt, int track) {
+	const char *title;
+
+	if (track < 0 || track >= dt->dt_NumTracks)
+		return NULL;
+
+	title = dt->dt_Text + dt->dt_Track[track];
+	if (title[0] == '\0')
+		return NULL;
+
+	return title;
+}
@@ -0,0 +1,81 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef FREEDB_H
+#define FREEDB_H 1
+
+/* Offline FreeDB database, built by FreeDBImport and read by freedb.c.
+ * The file is a header, the records and then the index. Numbers are big
+ * endian, so that it can be built on any machine.
+ *
+ * The index is an open addressed table of entries hashed on the disc ID.
+ * No entry is more than FREEDB_PROBE_SLOTS - 1 slots past the one it
+ * hashes to, and there are that many spare slots at the end, so a lookup
+ * reads one run of slots and never wraps around.
+ *
+ * A record is the number of tracks in one byte, then the disc title and
+ * the track titles, each NUL terminated.
+ */
+#define FREEDB_MAGIC   0x50434642 /* 'PCFB' */
+#define FREEDB_VERSION 1
+
+#define FREEDB_HEADER_SIZE 20 /* Magic, version, index offset, index bits, entries */
+#define FREEDB_ENTRY_SIZE  12 /* Disc ID, record offset, record size (0 = free slot) */
+#define FREEDB_PROBE_SLOTS 16
+
+#define FREEDB_MAX_INDEX_BITS 28
+
+struct FreeDB {
+	BPTR  fdb_File;
+	ULONG fdb_IndexOffset;
+	int   fdb_IndexBits;
+	ULONG fdb_NumEntries;
+};
+
+static inline ULONG get_be32(const UBYTE *p) {
+	return ((ULONG)p[0] << 24) | ((ULONG)p[1] << 16) | ((ULONG)p[2] << 8) | (ULONG)p[3];
+}
+
+static inline void put_be32(UBYTE *p, ULONG x) {
+	p[0] = x >> 24;
+	p[1] = x >> 16;
+	p[2] = x >> 8;
+	p[3] = x;
+}
+
+/* The low byte of a disc ID is the track count and the middle ones the
+ * length, so they are mixed before the top bits are taken */
+static inline ULONG get_freedb_slot(ULONG discid, int bits) {
+	return (discid * 0x9E3779B1) >> (32 - bits);
+}
+
+BOOL open_freedb(struct FreeDB *fdb, const char *path);
+void close_freedb(struct FreeDB *fdb);
+LONG read_freedb_record(struct FreeDB *fdb, ULONG discid, UBYTE *buffer, LONG size);
+
+#endif /* FREEDB_H */
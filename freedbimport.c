@@ -0,0 +1,473 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* Builds the database for the FREEDB tooltype from a FreeDB dump, with the
+ * xmcd files of the dump one after another in a single file, for example:
+ *
+ *   tar -xjOf freedb-complete.tar.bz2 >freedb.txt
+ *   FreeDBImport FROM freedb.txt TO PlayCDDA:FreeDB VERIFY
+ *
+ * Only the first entry of each disc ID is kept. VERIFY looks up every
+ * disc again afterwards, and reports how long a lookup takes.
+ */
+
+#include "playcdda.h"
+#include "freedb.h"
+
+#define TEMPLATE "FROM/A,TO/A,VERIFY/S"
+
+enum {
+	ARG_FROM,
+	ARG_TO,
+	ARG_VERIFY,
+	NUM_ARGS
+};
+
+#define MAX_LINE_LEN   1024
+#define MAX_DISC_IDS   8    /* In one DISCID= line */
+#define MIN_INDEX_BITS 4
+
+struct ImportEntry {
+	ULONG ie_DiscID;
+	ULONG ie_Offset;
+	ULONG ie_Size;
+};
+
+/* The xmcd file being read */
+struct XMCDEntry {
+	int   xe_NumIDs;
+	ULONG xe_DiscID[MAX_DISC_IDS];
+	char  xe_Title[MAX_TRACKS + 1][MAX_TITLE_LEN]; /* Disc title first */
+};
+
+struct Import {
+	BPTR                xi_Output;
+	ULONG               xi_Offset;     /* Where the next record goes */
+	struct ImportEntry *xi_Entry;
+	ULONG               xi_NumEntries;
+	ULONG               xi_MaxEntries;
+	ULONG               xi_Skipped;    /* No disc ID, or more tracks than a TOC can have */
+	ULONG               xi_Duplicates;
+	struct XMCDEntry    xi_XMCD;
+};
+
+static ULONG get_ticks(void) {
+	struct DateStamp ds;
+
+	DateStamp(&ds);
+
+	return ((ULONG)ds.ds_Days * 24 * 60 + ds.ds_Minute) * 60 * TICKS_PER_SECOND + ds.ds_Tick;
+}
+
+static BOOL add_entry(struct Import *xi, ULONG discid, ULONG offset, ULONG size) {
+	struct ImportEntry *entries;
+	ULONG               max;
+
+	if (xi->xi_NumEntries == xi->xi_MaxEntries) {
+		max = xi->xi_MaxEntries ? (xi->xi_MaxEntries * 2) : 65536;
+
+		entries = AllocVec(max * sizeof(*entries), MEMF_ANY);
+		if (entries == NULL)
+			return FALSE;
+
+		if (xi->xi_Entry != NULL) {
+			CopyMem(xi->xi_Entry, entries, xi->xi_NumEntries * sizeof(*entries));
+			FreeVec(xi->xi_Entry);
+		}
+
+		xi->xi_Entry      = entries;
+		xi->xi_MaxEntries = max;
+	}
+
+	xi->xi_Entry[xi->xi_NumEntries].ie_DiscID = discid;
+	xi->xi_Entry[xi->xi_NumEntries].ie_Offset = offset;
+	xi->xi_Entry[xi->xi_NumEntries].ie_Size   = size;
+	xi->xi_NumEntries++;
+
+	return TRUE;
+}
+
+/* Writes the record of the xmcd file that has been read and indexes it
+ * under each of its disc IDs */
+static BOOL end_xmcd(struct Import *xi) {
+	struct XMCDEntry *xe = &xi->xi_XMCD;
+	UBYTE             record[MAX_TITLES_SIZE];
+	ULONG             size;
+	int               tracks, len, i;
+
+	if (xe->xe_NumIDs == 0)
+		return TRUE;
+
+	/* The low byte of a disc ID is the track count */
+	tracks = xe->xe_DiscID[0] & 0xFF;
+	if (tracks == 0 || tracks > MAX_TRACKS) {
+		xi->xi_Skipped++;
+		return TRUE;
+	}
+
+	record[0] = tracks;
+	size = 1;
+
+	for (i = 0; i <= tracks; i++) {
+		len = strlen(xe->xe_Title[i]) + 1;
+		memcpy(&record[size], xe->xe_Title[i], len);
+		size += len;
+	}
+
+	/* Offsets have to fit in a Seek() */
+	if (xi->xi_Offset + size > 0x7FFFFFFF)
+		return FALSE;
+
+	if (FWrite(xi->xi_Output, record, size, 1) != 1)
+		return FALSE;
+
+	for (i = 0; i < xe->xe_NumIDs; i++) {
+		if (!add_entry(xi, xe->xe_DiscID[i], xi->xi_Offset, size))
+			return FALSE;
+	}
+
+	xi->xi_Offset += size;
+
+	return TRUE;
+}
+
+static void start_xmcd(struct Import *xi) {
+	struct XMCDEntry *xe = &xi->xi_XMCD;
+	int               i;
+
+	xe->xe_NumIDs = 0;
+
+	for (i = 0; i <= MAX_TRACKS; i++)
+		xe->xe_Title[i][0] = '\0';
+}
+
+/* Titles can be split over several lines. Whatever doesn't fit is cut. */
+static void add_title(struct XMCDEntry *xe, int title, const char *text) {
+	strlcat(xe->xe_Title[title], text, sizeof(xe->xe_Title[title]));
+}
+
+static void parse_disc_ids(struct XMCDEntry *xe, const char *text) {
+	char *end;
+
+	while (xe->xe_NumIDs < MAX_DISC_IDS) {
+		xe->xe_DiscID[xe->xe_NumIDs] = strtoul(text, &end, 16);
+		if (end == text)
+			break;
+
+		xe->xe_NumIDs++;
+
+		if (*end != ',')
+			break;
+
+		text = end + 1;
+	}
+}
+
+static void parse_line(struct Import *xi, char *line) {
+	struct XMCDEntry *xe = &xi->xi_XMCD;
+	char             *end;
+	int               track;
+
+	if (strncmp(line, "DISCID=", 7) == 0) {
+		parse_disc_ids(xe, line + 7);
+	} else if (strncmp(line, "DTITLE=", 7) == 0) {
+		add_title(xe, 0, line + 7);
+	} else if (strncmp(line, "TTITLE", 6) == 0) {
+		track = strtol(line + 6, &end, 10);
+		if (end != line + 6 && *end == '=' && track >= 0 && track < MAX_TRACKS)
+			add_title(xe, track + 1, end + 1);
+	}
+}
+
+/* Reads the dump and writes the records. The index is built afterwards,
+ * once it's known how big it has to be. */
+static BOOL read_dump(struct Import *xi, BPTR input) {
+	char  line[MAX_LINE_LEN];
+	BOOL  partial = FALSE;
+	BOOL  cut;
+	ULONG lines = 0;
+	int   len;
+
+	start_xmcd(xi);
+
+	SetIoErr(0);
+
+	while (FGets(input, (STRPTR)line, sizeof(line)) != NULL) {
+		len = strlen(line);
+		cut = (len == 0 || line[len - 1] != '\n');
+
+		/* The rest of a line that was too long */
+		if (partial) {
+			partial = cut;
+			continue;
+		}
+		partial = cut;
+
+		while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+			line[--len] = '\0';
+
+		if (strncmp(line, "# xmcd", 6) == 0) {
+			if (!end_xmcd(xi))
+				return FALSE;
+
+			start_xmcd(xi);
+		} else {
+			parse_line(xi, line);
+		}
+
+		if ((++lines & 0xFFFF) == 0 && CheckSignal(SIGBREAKF_CTRL_C)) {
+			SetIoErr(ERROR_BREAK);
+			return FALSE;
+		}
+	}
+
+	if (IoErr() != 0)
+		return FALSE;
+
+	return end_xmcd(xi);
+}
+
+/* Robin Hood insertion: an entry takes the slot of one that is closer to
+ * where it hashes to, which keeps the longest run short. Returns FALSE if
+ * an entry would end up FREEDB_PROBE_SLOTS or more from its slot, and the
+ * table has to be bigger. */
+static BOOL fill_index(struct Import *xi, struct ImportEntry *table, int bits) {
+	struct ImportEntry entry, tmp;
+	ULONG              num_slots = ((ULONG)1 << bits) + FREEDB_PROBE_SLOTS;
+	ULONG              i, slot, home;
+	ULONG              dist, other;
+
+	memset(table, 0, num_slots * sizeof(*table));
+
+	xi->xi_Duplicates = 0;
+
+	for (i = 0; i < xi->xi_NumEntries; i++) {
+		entry = xi->xi_Entry[i];
+		slot  = get_freedb_slot(entry.ie_DiscID, bits);
+		dist  = 0;
+
+		while (table[slot].ie_Size != 0) {
+			if (table[slot].ie_DiscID == entry.ie_DiscID) {
+				xi->xi_Duplicates++;
+				break;
+			}
+
+			home  = get_freedb_slot(table[slot].ie_DiscID, bits);
+			other = slot - home;
+
+			if (other < dist) {
+				tmp         = table[slot];
+				table[slot] = entry;
+				entry       = tmp;
+				dist        = other;
+			}
+
+			slot++;
+			dist++;
+
+			if (dist >= FREEDB_PROBE_SLOTS)
+				return FALSE;
+		}
+
+		if (table[slot].ie_Size == 0)
+			table[slot] = entry;
+	}
+
+	return TRUE;
+}
+
+static BOOL write_index(struct Import *xi, int *bits_ptr) {
+	struct ImportEntry *table = NULL;
+	UBYTE               buffer[FREEDB_ENTRY_SIZE];
+	ULONG               num_slots = 0, i;
+	int                 bits;
+	BOOL                result = FALSE;
+
+	/* At most half full */
+	for (bits = MIN_INDEX_BITS; bits < FREEDB_MAX_INDEX_BITS; bits++) {
+		if (((ULONG)1 << bits) >= xi->xi_NumEntries * 2)
+			break;
+	}
+
+	for (; bits <= FREEDB_MAX_INDEX_BITS; bits++) {
+		FreeVec(table);
+
+		num_slots = ((ULONG)1 << bits) + FREEDB_PROBE_SLOTS;
+
+		table = AllocVec(num_slots * sizeof(*table), MEMF_ANY);
+		if (table == NULL)
+			return FALSE;
+
+		if (fill_index(xi, table, bits))
+			break;
+	}
+
+	if (bits > FREEDB_MAX_INDEX_BITS)
+		goto cleanup;
+
+	for (i = 0; i < num_slots; i++) {
+		put_be32(&buffer[0], table[i].ie_DiscID);
+		put_be32(&buffer[4], table[i].ie_Offset);
+		put_be32(&buffer[8], table[i].ie_Size);
+
+		if (FWrite(xi->xi_Output, buffer, sizeof(buffer), 1) != 1)
+			goto cleanup;
+	}
+
+	*bits_ptr = bits;
+	result = TRUE;
+
+cleanup:
+	FreeVec(table);
+
+	return result;
+}
+
+static BOOL write_header(struct Import *xi, int bits) {
+	UBYTE header[FREEDB_HEADER_SIZE];
+
+	put_be32(&header[0],  FREEDB_MAGIC);
+	put_be32(&header[4],  FREEDB_VERSION);
+	put_be32(&header[8],  xi->xi_Offset);
+	put_be32(&header[12], bits);
+	put_be32(&header[16], xi->xi_NumEntries - xi->xi_Duplicates);
+
+	if (Flush(xi->xi_Output) == 0 || Seek(xi->xi_Output, 0, OFFSET_BEGINNING) == -1)
+		return FALSE;
+
+	return (Write(xi->xi_Output, header, sizeof(header)) == sizeof(header));
+}
+
+/* Looks every disc up again, as PlayCDDA would */
+static BOOL verify_database(struct Import *xi, const char *path) {
+	struct FreeDB fdb;
+	UBYTE         record[MAX_TITLES_SIZE];
+	ULONG         start, ticks, missing = 0;
+	ULONG         i, us;
+
+	if (!open_freedb(&fdb, path))
+		return FALSE;
+
+	start = get_ticks();
+
+	for (i = 0; i < xi->xi_NumEntries; i++) {
+		if (read_freedb_record(&fdb, xi->xi_Entry[i].ie_DiscID, record, sizeof(record)) <= 0)
+			missing++;
+	}
+
+	ticks = get_ticks() - start;
+
+	close_freedb(&fdb);
+
+	us = 0;
+	if (xi->xi_NumEntries != 0)
+		us = ((UQUAD)ticks * 1000000 / TICKS_PER_SECOND) / xi->xi_NumEntries;
+
+	Printf((CONST_STRPTR)"%lu lookups, %lu not found, %lu us each\n",
+		(unsigned long)xi->xi_NumEntries, (unsigned long)missing, (unsigned long)us);
+
+	return (missing == 0);
+}
+
+int main(void) {
+	struct RDArgs *rda;
+	LONG           args[NUM_ARGS];
+	struct Import  xi;
+	UBYTE          header[FREEDB_HEADER_SIZE];
+	BPTR           input = ZERO;
+	ULONG          start, ticks;
+	int            bits;
+	int            rc = RETURN_ERROR;
+
+	memset(args, 0, sizeof(args));
+	memset(&xi, 0, sizeof(xi));
+
+	rda = ReadArgs((CONST_STRPTR)TEMPLATE, args, NULL);
+	if (rda == NULL) {
+		PrintFault(IoErr(), (CONST_STRPTR)"FreeDBImport");
+		goto cleanup;
+	}
+
+	input = Open((CONST_STRPTR)args[ARG_FROM], MODE_OLDFILE);
+	if (input == ZERO)
+		goto error;
+
+	xi.xi_Output = Open((CONST_STRPTR)args[ARG_TO], MODE_NEWFILE);
+	if (xi.xi_Output == ZERO)
+		goto error;
+
+	start = get_ticks();
+
+	/* The header is filled in last */
+	memset(header, 0, sizeof(header));
+	if (FWrite(xi.xi_Output, header, sizeof(header), 1) != 1)
+		goto error;
+
+	xi.xi_Offset = sizeof(header);
+
+	if (!read_dump(&xi, input) || !write_index(&xi, &bits) || !write_header(&xi, bits))
+		goto error;
+
+	ticks = get_ticks() - start;
+	if (ticks == 0)
+		ticks = 1;
+
+	Close(xi.xi_Output);
+	xi.xi_Output = ZERO;
+
+	Printf((CONST_STRPTR)"%lu discs, %lu duplicates, %lu skipped, %lu.%02lu s, %lu discs/s\n",
+		(unsigned long)(xi.xi_NumEntries - xi.xi_Duplicates), (unsigned long)xi.xi_Duplicates,
+		(unsigned long)xi.xi_Skipped,
+		(unsigned long)(ticks / TICKS_PER_SECOND), (unsigned long)(ticks % TICKS_PER_SECOND * 100 / TICKS_PER_SECOND),
+		(unsigned long)((UQUAD)xi.xi_NumEntries * TICKS_PER_SECOND / ticks));
+
+	if (args[ARG_VERIFY] && !verify_database(&xi, (const char *)args[ARG_TO]))
+		goto cleanup;
+
+	rc = RETURN_OK;
+	goto cleanup;
+
+error:
+	PrintFault(IoErr(), (CONST_STRPTR)"FreeDBImport");
+
+cleanup:
+	if (xi.xi_Output != ZERO) {
+		Close(xi.xi_Output);
+		DeleteFile((CONST_STRPTR)args[ARG_TO]);
+	}
+
+	if (input != ZERO)
+		Close(input);
+
+	FreeVec(xi.xi_Entry);
+
+	if (rda != NULL)
+		FreeArgs(rda);
+
+	return rc;
+}
@@ -52,6 +52,10 @@
 
 #define STR(id) get_catalog_string(pcd, MSG_ ## id, MSG_ ## id ## _STR)
 
+enum {
+	RID_SEEK = 1
+};
+
 #ifndef __amigaos4__
 static APTR SetProcWindow(APTR new_win) {
 	struct Process *me = (struct Process *)FindTask(NULL);
@@ -350,6 +354,9 @@ BOOL create_gui(struct PlayCDDAData *pcd) {
 	DoMethod(OBJ(WINDOW), MUIM_Notify, MUIA_Window_CloseRequest, TRUE,
 		OBJ(APPLICATION), 2, MUIM_Application_ReturnID, MUIV_Application_ReturnID_Quit);
 
+	DoMethod(OBJ(SEEK_BAR), MUIM_Notify, MUIA_Pressed, FALSE,
+		OBJ(APPLICATION), 2, MUIM_Application_ReturnID, RID_SEEK);
+
 	set(OBJ(WINDOW), MUIA_Window_Open, TRUE);
 	if (XGET(OBJ(WINDOW), MUIA_Window_Open) == FALSE)
 		return FALSE;
@@ -364,12 +371,170 @@ void destroy_gui(struct PlayCDDAData *pcd) {
 		MUI_DisposeObject(OBJ(APPLICATION));
 }
 
+static void update_status(struct PlayCDDAData *pcd) {
+	struct PlayCDDAGUI   *pcg = &pcd->pcd_GUIData;
+	struct PlayCDDATOC   *toc = &pcd->pcd_TOC;
+	struct PlayCDDAStatus status;
+	const char           *title;
+	LONG                  secs = 0;
+	LONG                  length = 0;
+
+	get_player_status(pcd, &status);
+
+	if (is_drive_reading(pcd)) {
+		strlcpy(pcg->pcg_StatusText, STR(READING), sizeof(pcg->pcg_StatusText));
+	} else if (status.ps_State == PS_STOPPED || status.ps_Track < 0) {
+		title = get_disc_title(&pcd->pcd_Titles);
+		if (title == NULL)
+			title = (toc->toc_NumTracks != 0) ? STR(NOTRACK) : STR(NODISC);
+
+		strlcpy(pcg->pcg_StatusText, title, sizeof(pcg->pcg_StatusText));
+	} else {
+		secs = (status.ps_Addr - (LONG)toc->toc_Addr[status.ps_Track]) / CDDA_FRAMES_PER_SEC;
+		if (secs < 0)
+			secs = 0;
+
+		length = (toc->toc_Addr[status.ps_Track + 1] - toc->toc_Addr[status.ps_Track]) / CDDA_FRAMES_PER_SEC;
+		if (secs > length)
+			secs = length;
+
+		title = get_track_title(&pcd->pcd_Titles, status.ps_Track);
+		if (title != NULL) {
+			snprintf(pcg->pcg_StatusText, sizeof(pcg->pcg_StatusText), STR(PLAYING_TITLE),
+				title, (long)secs / 60, (long)secs % 60);
+		} else {
+			snprintf(pcg->pcg_StatusText, sizeof(pcg->pcg_StatusText), STR(PLAYING),
+				(long)status.ps_Track + 1, (long)secs / 60, (long)secs % 60);
+		}
+
+		pcd->pcd_DiscInfo.di_LastAddr = status.ps_Addr;
+	}
+
+	set(OBJ(STATUS_DISPLAY), MUIA_Text_Contents, pcg->pcg_StatusText);
+
+	/* The seek bar covers the current track, in seconds. Leave it alone
+	 * while it is being dragged. */
+	if (!XGET(OBJ(SEEK_BAR), MUIA_Pressed)) {
+		SetAttrs(OBJ(SEEK_BAR),
+			MUIA_NoNotify,     TRUE,
+			MUIA_Slider_Max,   length,
+			MUIA_Slider_Level, secs,
+			MUIA_Disabled,     length == 0,
+			TAG_END);
+	}
+}
+
+/* Continues playing from the given second of the current track */
+static void seek_track(struct PlayCDDAData *pcd, LONG secs) {
+	struct PlayCDDATOC   *toc = &pcd->pcd_TOC;
+	struct PlayCDDAStatus status;
+
+	get_player_status(pcd, &status);
+
+	if (status.ps_State == PS_STOPPED || status.ps_Track < 0)
+		return;
+
+	send_player_command(pcd, PCC_SEEK, toc->toc_Addr[status.ps_Track] + secs * CDDA_FRAMES_PER_SEC, 0);
+}
+
+/* Keeps where playing got to, for the next time the disc is inserted */
+static void save_disc_position(struct PlayCDDAData *pcd) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+
+	if (pcd->pcd_DiscInfo.di_LastAddr != pcg->pcg_SavedAddr) {
+		store_disc_info(&pcd->pcd_DiscInfo);
+		pcg->pcg_SavedAddr = pcd->pcd_DiscInfo.di_LastAddr;
+	}
+}
+
+/* The player drops whatever it has cached and starts caching the new
+ * tracks */
+static void new_disc(struct PlayCDDAData *pcd) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+
+	save_disc_position(pcd);
+
+	pcd->pcd_DiscInfo  = pcd->pcd_DriveData.pcdd_Disc;
+	pcg->pcg_SavedAddr = pcd->pcd_DiscInfo.di_LastAddr;
+
+	pcd->pcd_Titles = pcd->pcd_DriveData.pcdd_Titles;
+	pcd->pcd_TOC    = pcd->pcd_DiscInfo.di_TOC;
+
+	update_status(pcd);
+
+	send_player_command(pcd, PCC_PREFETCH, 0, 0);
+}
+
+static void handle_drive_replies(struct PlayCDDAData *pcd) {
+	pcm_command_t command;
+	BOOL          result;
+
+	while (get_drive_reply(pcd, &command, &result)) {
+		switch (command) {
+			case PCC_OPENDRIVE:
+				/* The player works on copies of the drive's IORequest */
+				if (result) {
+					start_player_proc(pcd);
+					send_drive_command(pcd, PCC_READTOC, 0);
+				}
+				update_status(pcd);
+				break;
+
+			case PCC_READTOC:
+				new_disc(pcd);
+				break;
+
+			case PCC_CHECKDISC:
+				/* Nothing to do if it's the same disc */
+				if (result)
+					new_disc(pcd);
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
 int main_loop(struct PlayCDDAData *pcd) {
 	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
-	ULONG sigmask, signals;
+	ULONG sigmask, dcsignal, statussig, playersig, drivesig, alarmsig, signals;
+	ULONG id;
 
-	while (DoMethod(OBJ(APPLICATION), MUIM_Application_NewInput, &sigmask) != MUIV_Application_ReturnID_Quit) {
-		signals = Wait(sigmask | SIGBREAKF_CTRL_C | SIGBREAKF_CTRL_F);
+	dcsignal  = (ULONG)1 << pcd->pcd_DCSignal;
+	statussig = (ULONG)1 << pcd->pcd_StatusSignal;
+
+	drivesig  = get_drive_signal(pcd);
+	alarmsig  = get_alarm_signal(pcd);
+
+	/* The disc has been asked for before the window was opened */
+	update_status(pcd);
+
+	while ((id = DoMethod(OBJ(APPLICATION), MUIM_Application_NewInput, &sigmask)) != MUIV_Application_ReturnID_Quit) {
+		if (id == RID_SEEK) {
+			seek_track(pcd, XGET(OBJ(SEEK_BAR), MUIA_Slider_Level));
+			continue;
+		}
+
+		playersig = get_player_signal(pcd);
+		signals = Wait(sigmask | dcsignal | statussig | playersig | drivesig | alarmsig | SIGBREAKF_CTRL_C | SIGBREAKF_CTRL_F);
+
+		if (signals & playersig)
+			handle_player_replies(pcd);
+
+		if (signals & drivesig)
+			handle_drive_replies(pcd);
+
+		if (signals & statussig)
+			update_status(pcd);
+
+		/* Drives can send a burst of these for one change, so the disc
+		 * is only checked once they have stopped for a while */
+		if (signals & dcsignal)
+			set_alarm(pcd, DISC_SETTLE_MS);
+
+		if (check_alarm(pcd))
+			send_drive_command(pcd, PCC_CHECKDISC, 0);
 
 		if (signals & SIGBREAKF_CTRL_C)
 			break;
@@ -378,6 +543,8 @@ int main_loop(struct PlayCDDAData *pcd) {
 			set(OBJ(WINDOW), MUIA_Window_Open, TRUE);
 	}
 
+	save_disc_position(pcd);
+
 	return RETURN_OK;
 }
 
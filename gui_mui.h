@@ -55,6 +55,10 @@ enum {
 
 struct PlayCDDAGUI {
 	Object *pcg_Obj[OID_MAX];
+
+	char    pcg_StatusText[128];
+
+	LONG    pcg_SavedAddr; /* pcd_DiscInfo.di_LastAddr in the disc info file */
 };
 
 #endif /* GUI_MUI_H */
@@ -501,20 +501,79 @@ void destroy_gui(struct PlayCDDAData *pcd) {
 		CloseLibrary(IntuitionBase);
 }
 
+static void update_status(struct PlayCDDAData *pcd);
+
+/* The track buttons stay disabled while the disc is being read. Only the
+ * ones that change are touched. */
 static void update_gui(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
 	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+	BOOL reading = is_drive_reading(pcd);
 	struct Window *window;
+	ULONG mask = 0;
 	int i;
 
-	GetAttr(WINDOW_Window, OBJ(WINDOW), (APTR)&window);
+	if (!reading) {
+		for (i = 0; i < MAX_TRACKS; i++) {
+			if (toc->toc_Type[i] == TRACK_CDDA)
+				mask |= (ULONG)1 << i;
+		}
+	}
 
-	for (i = 0; i < MAX_TRACKS; i++) {
-		SetGadgetAttrs((struct Gadget *)OBJ(TRACK01 + i), window, NULL,
-			GA_Disabled, (toc->toc_Type[i] == TRACK_CDDA) ? FALSE : TRUE,
-			TAG_END);
+	if (mask != pcg->pcg_TrackMask) {
+		GetAttr(WINDOW_Window, OBJ(WINDOW), (APTR)&window);
+
+		for (i = 0; i < MAX_TRACKS; i++) {
+			if (((mask ^ pcg->pcg_TrackMask) & ((ULONG)1 << i)) == 0)
+				continue;
+
+			SetGadgetAttrs((struct Gadget *)OBJ(TRACK01 + i), window, NULL,
+				GA_Disabled, (mask & ((ULONG)1 << i)) ? FALSE : TRUE,
+				TAG_END);
+		}
+
+		pcg->pcg_TrackMask = mask;
+	}
+
+	update_status(pcd);
+}
+
+/* Has the TOC of the disc in the drive read by the drive process.
+ * new_disc() is called once it's back. */
+static void read_disc(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
+	send_drive_command(pcd, PCC_READTOC, 0);
+	update_gui(pcd, toc);
+}
+
+/* Keeps where playing got to, for the next time the disc is inserted */
+static void save_disc_position(struct PlayCDDAData *pcd) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+
+	if (pcd->pcd_DiscInfo.di_LastAddr != pcg->pcg_SavedAddr) {
+		store_disc_info(&pcd->pcd_DiscInfo);
+		pcg->pcg_SavedAddr = pcd->pcd_DiscInfo.di_LastAddr;
 	}
 }
 
+/* The player drops whatever it has cached and starts caching the new
+ * tracks. Playing a disc that has been played before continues from where
+ * it was left. */
+static void new_disc(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+
+	save_disc_position(pcd);
+
+	pcd->pcd_DiscInfo  = pcd->pcd_DriveData.pcdd_Disc;
+	pcg->pcg_SavedAddr = pcd->pcd_DiscInfo.di_LastAddr;
+	pcg->pcg_Resume    = (pcd->pcd_DiscInfo.di_LastAddr >= 0);
+
+	pcd->pcd_Titles = pcd->pcd_DriveData.pcdd_Titles;
+
+	*toc = pcd->pcd_DiscInfo.di_TOC;
+	update_gui(pcd, toc);
+
+	send_player_command(pcd, PCC_PREFETCH, 0, 0);
+}
+
 static struct Node *get_nth_node(struct List *list, int i) {
 	struct Node *node;
 
@@ -527,24 +586,221 @@ static struct Node *get_nth_node(struct List *list, int i) {
 	return node;
 }
 
+/* Puts the check mark back on a drive in the menu */
+static void select_drive_item(struct PlayCDDAData *pcd, struct CDROMDrive *cdd) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+	struct Node        *node;
+	Object             *menu_item;
+	int                 index = 0;
+
+	for (node = pcd->pcd_CDDrives.lh_Head; node->ln_Succ != NULL; node = node->ln_Succ) {
+		if (node == &cdd->cdd_Node)
+			break;
+		index++;
+	}
+
+	if (node->ln_Succ == NULL || index >= 32)
+		return;
+
+	menu_item = (Object *)DoMethod(OBJ(MENUSTRIP), MM_FINDID, 0, MID_PROJECT_CDROMDRIVE_01 + index);
+	if (menu_item != NULL)
+		SetAttrs(menu_item, MA_Selected, TRUE, TAG_END);
+}
+
+/* Switches to another drive from the drive process. The player works on
+ * copies of the drive's IORequest, so it's restarted once it's open. */
+static void switch_drive(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc, struct CDROMDrive *cdd) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+
+	kill_player_proc(pcd);
+
+	save_disc_position(pcd);
+
+	pcg->pcg_DriveFailed = FALSE;
+
+	send_drive_command(pcd, PCC_OPENDRIVE, (pcm_arg_t)cdd);
+
+	memset(toc, 0, sizeof(*toc));
+	update_gui(pcd, toc);
+}
+
+static void handle_drive_replies(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+	pcm_command_t       command;
+	BOOL                result;
+
+	while (get_drive_reply(pcd, &command, &result)) {
+		switch (command) {
+			case PCC_OPENDRIVE:
+				if (result) {
+					start_player_proc(pcd);
+					read_disc(pcd, toc);
+				} else if (!pcg->pcg_DriveFailed && pcd->pcd_CurrentDrive != NULL) {
+					/* Back to the drive that was open before, which is still
+					 * pcd_CurrentDrive. The status says what happened. */
+					pcg->pcg_DriveFailed = TRUE;
+
+					select_drive_item(pcd, pcd->pcd_CurrentDrive);
+					send_drive_command(pcd, PCC_OPENDRIVE, (pcm_arg_t)pcd->pcd_CurrentDrive);
+				} else {
+					/* That one is gone as well, so there's no drive and no
+					 * player until a drive is picked, which may be the same
+					 * one again */
+					pcg->pcg_DriveFailed = TRUE;
+					pcd->pcd_CurrentDrive = NULL;
+
+					update_gui(pcd, toc);
+				}
+				break;
+
+			case PCC_READTOC:
+				new_disc(pcd, toc);
+				break;
+
+			case PCC_CHECKDISC:
+				/* Nothing to do if it's the same disc */
+				if (result)
+					new_disc(pcd, toc);
+				break;
+
+			default:
+				break;
+		}
+	}
+}
+
+
+static void update_status(struct PlayCDDAData *pcd) {
+	struct PlayCDDAGUI   *pcg = &pcd->pcd_GUIData;
+	struct PlayCDDATOC   *toc = &pcd->pcd_TOC;
+	struct PlayCDDAStatus status;
+	const char           *title;
+	LONG                  secs = 0;
+	LONG                  length = 0;
+	struct Window        *window;
+
+	get_player_status(pcd, &status);
+
+	if (is_drive_reading(pcd)) {
+		strlcpy(pcg->pcg_StatusText, STR(READING), sizeof(pcg->pcg_StatusText));
+	} else if (status.ps_State == PS_STOPPED || status.ps_Track < 0) {
+		title = get_disc_title(&pcd->pcd_Titles);
+		if (pcg->pcg_DriveFailed)
+			title = STR(DRIVE_FAILED);
+		else if (title == NULL)
+			title = (toc->toc_NumTracks != 0) ? STR(NOTRACK) : STR(NODISC);
+
+		strlcpy(pcg->pcg_StatusText, title, sizeof(pcg->pcg_StatusText));
+	} else {
+		secs = (status.ps_Addr - (LONG)toc->toc_Addr[status.ps_Track]) / CDDA_FRAMES_PER_SEC;
+		if (secs < 0)
+			secs = 0;
+
+		length = (toc->toc_Addr[status.ps_Track + 1] - toc->toc_Addr[status.ps_Track]) / CDDA_FRAMES_PER_SEC;
+		if (secs > length)
+			secs = length;
+
+		title = get_track_title(&pcd->pcd_Titles, status.ps_Track);
+		if (title != NULL) {
+			snprintf(pcg->pcg_StatusText, sizeof(pcg->pcg_StatusText), STR(PLAYING_TITLE),
+				title, (long)secs / 60, (long)secs % 60);
+		} else {
+			snprintf(pcg->pcg_StatusText, sizeof(pcg->pcg_StatusText), STR(PLAYING),
+				(long)status.ps_Track + 1, (long)secs / 60, (long)secs % 60);
+		}
+
+		pcd->pcd_DiscInfo.di_LastAddr = status.ps_Addr;
+	}
+
+	GetAttr(WINDOW_Window, OBJ(WINDOW), (APTR)&window);
+
+	SetGadgetAttrs((struct Gadget *)OBJ(STATUS_DISPLAY), window, NULL,
+		GA_Text, pcg->pcg_StatusText,
+		TAG_END);
+
+	/* The seek bar covers the current track, in seconds */
+	SetGadgetAttrs((struct Gadget *)OBJ(SEEK_BAR), window, NULL,
+		SLIDER_Max,   length,
+		SLIDER_Level, secs,
+		GA_Disabled,  length == 0,
+		TAG_END);
+}
+
+/* Continues playing from the given second of the current track */
+static void seek_track(struct PlayCDDAData *pcd, const struct PlayCDDATOC *toc, LONG secs) {
+	struct PlayCDDAStatus status;
+
+	get_player_status(pcd, &status);
+
+	if (status.ps_State == PS_STOPPED || status.ps_Track < 0)
+		return;
+
+	send_player_command(pcd, PCC_SEEK, toc->toc_Addr[status.ps_Track] + secs * CDDA_FRAMES_PER_SEC, 0);
+}
+
+/* Starts playing from the given track, or the first audio track if -1.
+ * The first time a disc that has been played before is played from -1, it
+ * continues from where it was left instead. */
+static void play_track(struct PlayCDDAData *pcd, const struct PlayCDDATOC *toc, int track) {
+	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
+	LONG start_addr, end_addr;
+	int  i;
+
+	pcg->pcg_DriveFailed = FALSE;
+
+	if (pcg->pcg_Resume) {
+		pcg->pcg_Resume = FALSE;
+
+		if (track < 0 && get_audio_run(toc, pcd->pcd_DiscInfo.di_LastAddr, &start_addr, &end_addr)) {
+			send_player_command(pcd, PCC_PLAY, start_addr, end_addr);
+			return;
+		}
+	}
+
+	if (track < 0) {
+		for (i = 0; i < toc->toc_NumTracks; i++) {
+			if (toc->toc_Type[i] == TRACK_CDDA)
+				break;
+		}
+		track = i;
+	}
+
+	if (get_play_range(toc, track, &start_addr, &end_addr))
+		send_player_command(pcd, PCC_PLAY, start_addr, end_addr);
+}
+
 int main_loop(struct PlayCDDAData *pcd) {
 	struct PlayCDDAGUI *pcg = &pcd->pcd_GUIData;
-	struct PlayCDDATOC toc;
+	struct PlayCDDATOC *toc = &pcd->pcd_TOC;
 	struct Window *window;
-	ULONG sigmask, dcsignal, signals, result;
+	ULONG sigmask, dcsignal, statussig, playersig, drivesig, alarmsig, signals, result;
 	UWORD code;
 	BOOL  done = FALSE;
 	int   menu_id;
 	int   gadget_id;
 
-	dcsignal = (ULONG)1 << pcd->pcd_DCSignal;
+	dcsignal  = (ULONG)1 << pcd->pcd_DCSignal;
+	statussig = (ULONG)1 << pcd->pcd_StatusSignal;
+
+	drivesig  = get_drive_signal(pcd);
+	alarmsig  = get_alarm_signal(pcd);
 
-	read_toc(pcd, &toc);
-	update_gui(pcd, &toc);
+	/* The disc has been asked for before the window was opened */
+	update_gui(pcd, toc);
 
 	while (!done) {
 		GetAttr(WINDOW_SigMask, OBJ(WINDOW), &sigmask);
-		signals = Wait(sigmask | dcsignal | SIGBREAKF_CTRL_C | SIGBREAKF_CTRL_F);
+		playersig = get_player_signal(pcd);
+		signals = Wait(sigmask | dcsignal | statussig | playersig | drivesig | alarmsig | SIGBREAKF_CTRL_C | SIGBREAKF_CTRL_F);
+
+		if (signals & playersig)
+			handle_player_replies(pcd);
+
+		if (signals & drivesig)
+			handle_drive_replies(pcd, toc);
+
+		if (signals & statussig)
+			update_status(pcd);
 
 		if (signals & SIGBREAKF_CTRL_C)
 			done = TRUE;
@@ -555,10 +811,13 @@ int main_loop(struct PlayCDDAData *pcd) {
 				ScreenToFront(window->WScreen);
 		}
 
-		if (signals & dcsignal) {
-			read_toc(pcd, &toc);
-			update_gui(pcd, &toc);
-		}
+		/* Drives can send a burst of these for one change, so the disc
+		 * is only checked once they have stopped for a while */
+		if (signals & dcsignal)
+			set_alarm(pcd, DISC_SETTLE_MS);
+
+		if (check_alarm(pcd))
+			send_drive_command(pcd, PCC_CHECKDISC, 0);
 
 		if (signals & sigmask) {
 			while ((result = DoMethod(OBJ(WINDOW), WM_HANDLEINPUT, &code)) != WMHI_LASTMSG) {
@@ -585,15 +844,8 @@ int main_loop(struct PlayCDDAData *pcd) {
 
 										cdd = (struct CDROMDrive *)get_nth_node(&pcd->pcd_CDDrives,
 											menu_id - MID_PROJECT_CDROMDRIVE_01);
-										if (cdd != NULL && cdd != pcd->pcd_CurrentDrive) {
-											close_cdrom_drive(pcd);
-
-											/* FIXME: Add error handling */
-											open_cdrom_drive(pcd, cdd);
-
-											read_toc(pcd, &toc);
-											update_gui(pcd, &toc);
-										}
+										if (cdd != NULL && cdd != pcd->pcd_CurrentDrive)
+											switch_drive(pcd, toc, cdd);
 									}
 									break;
 							}
@@ -605,21 +857,36 @@ int main_loop(struct PlayCDDAData *pcd) {
 						switch (gadget_id) {
 							case OID_BUTTON_BAR:
 								switch (code) {
-									/* FIXME: Implement tapedeck controls */
+									case SBID_STOP:
+										send_player_command(pcd, PCC_STOP, 0, 0);
+										break;
+
+									case SBID_PAUSE:
+										send_player_command(pcd, PCC_PAUSE, 0, 0);
+										break;
+
+									case SBID_PLAY:
+										/* Resumes if paused */
+										play_track(pcd, toc, -1);
+										break;
+
+									/* FIXME: Implement eject and previous/next track */
 								}
 								break;
 
 							case OID_SEEK_BAR:
-								/* FIXME: Implement seeking */
+								seek_track(pcd, toc, code);
 								break;
 
 							case OID_VOLUME_SLIDER:
-								set_volume(pcd, code);
+								if (!send_player_command(pcd, PCC_SETVOLUME, code, 0))
+									set_volume(pcd, code);
 								break;
 
 							default:
 								if (gadget_id >= OID_TRACK01 && gadget_id <= OID_TRACK32) {
-									/* FIXME: Implement track selection */
+									send_player_command(pcd, PCC_STOP, 0, 0);
+									play_track(pcd, toc, gadget_id - OID_TRACK01);
 								}
 								break;
 						}
@@ -643,6 +910,8 @@ int main_loop(struct PlayCDDAData *pcd) {
 		}
 	}
 
+	save_disc_position(pcd);
+
 	return RETURN_OK;
 }
 
@@ -72,6 +72,13 @@ struct PlayCDDAGUI {
 	struct Screen         *pcg_Screen;
 	struct List            pcg_ButtonList;
 
+	char                   pcg_StatusText[128];
+	ULONG                  pcg_TrackMask; /* Track buttons that are enabled */
+
+	LONG                   pcg_SavedAddr; /* pcd_DiscInfo.di_LastAddr in the disc info file */
+	BOOL                   pcg_Resume;    /* Play continues from pcd_DiscInfo.di_LastAddr */
+	BOOL                   pcg_DriveFailed; /* The last drive picked couldn't be opened */
+
 	Object                *pcg_Obj[OID_MAX];
 };
 
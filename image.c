@@ -0,0 +1,653 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+#include <stdio.h>
+
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+/* Largest cue sheet we bother to read */
+#define MAX_CUE_SIZE (64*1024)
+
+static ULONG get_le32(const UBYTE *p) {
+	return ((ULONG)p[3] << 24) | ((ULONG)p[2] << 16) | ((ULONG)p[1] << 8) | (ULONG)p[0];
+}
+
+static UWORD get_le16(const UBYTE *p) {
+	return ((UWORD)p[1] << 8) | (UWORD)p[0];
+}
+
+static LONG get_file_size(BPTR file) {
+	LONG size;
+
+	Seek(file, 0, OFFSET_END);
+	size = Seek(file, 0, OFFSET_BEGINNING);
+
+	return size;
+}
+
+/* Finds the sample data of a WAV file, which has to be CD audio */
+static BOOL parse_wav_header(struct CDImageFile *cif, LONG file_size) {
+	UBYTE header[24];
+	ULONG pos = 12;
+	ULONG size;
+	BOOL  format_ok = FALSE;
+
+	if (Read(cif->if_File, header, 12) != 12 ||
+		memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0)
+	{
+		return FALSE;
+	}
+
+	while (pos + 8 <= (ULONG)file_size) {
+		if (Read(cif->if_File, header, 8) != 8)
+			return FALSE;
+
+		size = get_le32(header + 4);
+		pos += 8;
+
+		if (memcmp(header, "data", 4) == 0) {
+			if (!format_ok)
+				return FALSE;
+
+			if (size > (ULONG)file_size - pos)
+				size = file_size - pos;
+
+			cif->if_DataStart = pos;
+			cif->if_DataSize  = size;
+			return TRUE;
+		}
+
+		if (memcmp(header, "fmt ", 4) == 0 && size >= 16) {
+			if (Read(cif->if_File, header, 16) != 16)
+				return FALSE;
+
+			/* PCM, stereo, 44.1 kHz, 16 bits */
+			if (get_le16(header) != 1 || get_le16(header + 2) != 2 ||
+				get_le32(header + 4) != 44100 || get_le16(header + 14) != 16)
+			{
+				return FALSE;
+			}
+
+			format_ok = TRUE;
+		}
+
+		/* Chunks are padded to an even size */
+		pos += size + (size & 1);
+
+		if (Seek(cif->if_File, pos, OFFSET_BEGINNING) == -1)
+			return FALSE;
+	}
+
+	return FALSE;
+}
+
+#ifdef HAVE_MMAP
+/* Maps the whole file, so that reads become pointers into it. Reads go
+ * through the file handle if it can't be done. */
+static void map_image_file(struct CDImageFile *cif, const char *path) {
+	ULONG size = cif->if_DataStart + cif->if_DataSize;
+	void *map;
+	int   fd;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return;
+
+	map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (map == MAP_FAILED)
+		return;
+
+	/* Played from start to end, so let the host read ahead */
+	madvise(map, size, MADV_SEQUENTIAL);
+
+	cif->if_Map     = map;
+	cif->if_MapSize = size;
+}
+#endif
+
+enum {
+	IMAGE_BINARY,
+	IMAGE_MOTOROLA,
+	IMAGE_WAVE
+};
+
+/* State while the image is put together from the cue sheet */
+struct ImageBuilder {
+	struct CDImage *ib_Image;
+	LONG            ib_FileAddr;   /* Sector that the current file starts at */
+	LONG            ib_Pregap;     /* Silence added before the current track */
+	LONG            ib_NewPregap;  /* ...of it that has no segment yet */
+	int             ib_Track;      /* -1 before the first TRACK */
+	BOOL            ib_TrackIndexed;
+	ULONG           ib_SectorSize; /* Of the current track */
+	LONG            ib_AnchorFrame; /* Last index point in the current file... */
+	ULONG           ib_AnchorOffset; /* ...where it is in the file... */
+	ULONG           ib_AnchorSize; /* ...and the sector size from there on */
+};
+
+/* Sectors in the current file, so the next one knows where it starts */
+static LONG file_frames(const struct ImageBuilder *ib) {
+	const struct CDImage     *ci  = ib->ib_Image;
+	const struct CDImageFile *cif = &ci->ci_File[ci->ci_NumFiles - 1];
+
+	if (ib->ib_AnchorSize == 0 || cif->if_DataSize < ib->ib_AnchorOffset)
+		return ib->ib_AnchorFrame;
+
+	return ib->ib_AnchorFrame + (cif->if_DataSize - ib->ib_AnchorOffset) / ib->ib_AnchorSize;
+}
+
+static BOOL add_image_file(struct ImageBuilder *ib, const char *path, int type) {
+	struct CDImage     *ci = ib->ib_Image;
+	struct CDImageFile *cif;
+	LONG                size;
+
+	if (ci->ci_NumFiles >= MAX_IMAGE_FILES)
+		return FALSE;
+
+	if (ci->ci_NumFiles > 0)
+		ib->ib_FileAddr += file_frames(ib);
+
+	cif = &ci->ci_File[ci->ci_NumFiles++];
+
+	cif->if_File = Open((CONST_STRPTR)path, MODE_OLDFILE);
+	if (cif->if_File == ZERO)
+		return FALSE;
+
+	size = get_file_size(cif->if_File);
+	if (size < 0)
+		return FALSE;
+
+	if (type == IMAGE_WAVE) {
+		if (!parse_wav_header(cif, size))
+			return FALSE;
+	} else {
+		cif->if_DataStart = 0;
+		cif->if_DataSize  = size;
+	}
+
+	cif->if_Pos  = ~0;
+	cif->if_Swap = (type == IMAGE_MOTOROLA);
+
+#ifdef HAVE_MMAP
+	map_image_file(cif, path);
+#endif
+
+	ib->ib_AnchorFrame  = 0;
+	ib->ib_AnchorOffset = 0;
+	ib->ib_AnchorSize   = ib->ib_SectorSize;
+
+	return TRUE;
+}
+
+static BOOL add_image_track(struct ImageBuilder *ib, int type, ULONG sector_size) {
+	struct CDImage *ci = ib->ib_Image;
+
+	if (ci->ci_NumFiles == 0 || ib->ib_Track + 1 >= MAX_TRACKS)
+		return FALSE;
+
+	/* A track without INDEX 01 */
+	if (ib->ib_Track >= 0 && !ib->ib_TrackIndexed)
+		return FALSE;
+
+	ib->ib_Track++;
+	ib->ib_TrackIndexed = FALSE;
+	ib->ib_SectorSize   = sector_size;
+
+	ci->ci_TOC.toc_Type[ib->ib_Track] = type;
+	ci->ci_TOC.toc_NumTracks = ib->ib_Track + 1;
+
+	return TRUE;
+}
+
+/* Silence that isn't in any file, so that it doesn't read as whatever is
+ * in the file after the last segment */
+static BOOL add_silent_segment(struct ImageBuilder *ib, LONG addr) {
+	struct CDImage        *ci = ib->ib_Image;
+	struct CDImageSegment *seg;
+
+	if (ci->ci_NumSegments >= MAX_IMAGE_SEGMENTS)
+		return FALSE;
+
+	seg = &ci->ci_Segment[ci->ci_NumSegments++];
+
+	seg->is_Addr       = addr;
+	seg->is_File       = -1;
+	seg->is_Offset     = 0;
+	seg->is_SectorSize = CDDA_FRAME_SIZE;
+
+	return TRUE;
+}
+
+/* INDEX 00 starts the pregap that is in the file, INDEX 01 the track */
+static BOOL add_image_index(struct ImageBuilder *ib, int index, LONG frame) {
+	struct CDImage        *ci = ib->ib_Image;
+	struct CDImageSegment *seg;
+	ULONG                  offset;
+	LONG                   addr;
+
+	if (ib->ib_Track < 0 || frame < ib->ib_AnchorFrame)
+		return FALSE;
+
+	/* Later index points only matter for seeking within a track */
+	if (index > 1 || (index == 0 && ib->ib_TrackIndexed))
+		return TRUE;
+
+	offset = ib->ib_AnchorOffset + (frame - ib->ib_AnchorFrame) * ib->ib_AnchorSize;
+	addr   = ib->ib_FileAddr + ib->ib_Pregap + frame;
+
+	ib->ib_AnchorFrame  = frame;
+	ib->ib_AnchorOffset = offset;
+	ib->ib_AnchorSize   = ib->ib_SectorSize;
+
+	/* A PREGAP comes right before the first index point of the track */
+	if (ib->ib_NewPregap > 0) {
+		if (!add_silent_segment(ib, addr - ib->ib_NewPregap))
+			return FALSE;
+
+		ib->ib_NewPregap = 0;
+	}
+
+	if (index == 1) {
+		ci->ci_TOC.toc_Addr[ib->ib_Track] = addr;
+		ib->ib_TrackIndexed = TRUE;
+	}
+
+	if (ci->ci_NumSegments > 0) {
+		seg = &ci->ci_Segment[ci->ci_NumSegments - 1];
+
+		/* Same file and sector size, so the last segment carries on */
+		if (seg->is_File == ci->ci_NumFiles - 1 && seg->is_SectorSize == ib->ib_SectorSize &&
+			seg->is_Offset + (addr - seg->is_Addr) * seg->is_SectorSize == offset)
+		{
+			return TRUE;
+		}
+	}
+
+	if (ci->ci_NumSegments >= MAX_IMAGE_SEGMENTS)
+		return FALSE;
+
+	seg = &ci->ci_Segment[ci->ci_NumSegments++];
+
+	seg->is_Addr       = addr;
+	seg->is_File       = ci->ci_NumFiles - 1;
+	seg->is_Offset     = offset;
+	seg->is_SectorSize = ib->ib_SectorSize;
+
+	return TRUE;
+}
+
+static BOOL finish_image(struct ImageBuilder *ib) {
+	struct CDImage *ci = ib->ib_Image;
+
+	if (ib->ib_Track < 0 || !ib->ib_TrackIndexed)
+		return FALSE;
+
+	ci->ci_TOC.toc_Addr[ib->ib_Track + 1] = ib->ib_FileAddr + ib->ib_Pregap + file_frames(ib);
+
+	return TRUE;
+}
+
+/* Next word of a cue sheet line, with quotes removed */
+static char *next_word(char **line) {
+	char *p = *line;
+	char *word;
+
+	while (*p == ' ' || *p == '\t')
+		p++;
+
+	if (*p == '\0')
+		return NULL;
+
+	if (*p == '"') {
+		word = ++p;
+		while (*p != '\0' && *p != '"')
+			p++;
+	} else {
+		word = p;
+		while (*p != '\0' && *p != ' ' && *p != '\t')
+			p++;
+	}
+
+	if (*p != '\0')
+		*p++ = '\0';
+
+	*line = p;
+	return word;
+}
+
+/* mm:ss:ff */
+static LONG parse_msf(const char *msf) {
+	unsigned m, s, f;
+	char     c;
+
+	if (sscanf(msf, "%u:%u:%u%c", &m, &s, &f, &c) != 3 || s >= 60 || f >= CDDA_FRAMES_PER_SEC)
+		return -1;
+
+	return (m * 60 + s) * CDDA_FRAMES_PER_SEC + f;
+}
+
+static BOOL parse_cue_line(struct ImageBuilder *ib, const char *cue_path, char *line) {
+	char *keyword, *arg, *type;
+	char  path[1024];
+	LONG  frame;
+
+	keyword = next_word(&line);
+	if (keyword == NULL)
+		return TRUE;
+
+	if (strcasecmp(keyword, "FILE") == 0) {
+		arg  = next_word(&line);
+		type = next_word(&line);
+		if (arg == NULL || type == NULL)
+			return FALSE;
+
+		/* Relative to the cue sheet */
+		strlcpy(path, cue_path, sizeof(path));
+		*PathPart((STRPTR)path) = '\0';
+		AddPart((STRPTR)path, (CONST_STRPTR)arg, sizeof(path));
+
+		if (strcasecmp(type, "BINARY") == 0)
+			return add_image_file(ib, path, IMAGE_BINARY);
+		if (strcasecmp(type, "MOTOROLA") == 0)
+			return add_image_file(ib, path, IMAGE_MOTOROLA);
+		if (strcasecmp(type, "WAVE") == 0)
+			return add_image_file(ib, path, IMAGE_WAVE);
+
+		/* MP3, AIFF */
+		return FALSE;
+	}
+
+	if (strcasecmp(keyword, "TRACK") == 0) {
+		arg  = next_word(&line);
+		type = next_word(&line);
+		if (arg == NULL || type == NULL)
+			return FALSE;
+
+		if (strcasecmp(type, "AUDIO") == 0)
+			return add_image_track(ib, TRACK_CDDA, CDDA_FRAME_SIZE);
+		if (strcasecmp(type, "MODE1/2048") == 0)
+			return add_image_track(ib, TRACK_DATA, 2048);
+		if (strcasecmp(type, "MODE2/2336") == 0)
+			return add_image_track(ib, TRACK_DATA, 2336);
+
+		return add_image_track(ib, TRACK_DATA, CDDA_FRAME_SIZE);
+	}
+
+	if (strcasecmp(keyword, "INDEX") == 0) {
+		arg  = next_word(&line);
+		type = next_word(&line);
+		if (arg == NULL || type == NULL || (frame = parse_msf(type)) < 0)
+			return FALSE;
+
+		return add_image_index(ib, atoi(arg), frame);
+	}
+
+	if (strcasecmp(keyword, "PREGAP") == 0) {
+		arg = next_word(&line);
+		if (arg == NULL || (frame = parse_msf(arg)) < 0 || ib->ib_TrackIndexed)
+			return FALSE;
+
+		/* Silence that isn't in the file */
+		ib->ib_Pregap    += frame;
+		ib->ib_NewPregap += frame;
+		return TRUE;
+	}
+
+	/* REM, TITLE, PERFORMER, CATALOG, FLAGS, POSTGAP... */
+	return TRUE;
+}
+
+static BOOL parse_cue_sheet(struct ImageBuilder *ib, const char *cue_path) {
+	BPTR  file;
+	char *text = NULL;
+	char *line, *end;
+	LONG  size;
+	BOOL  result = FALSE;
+
+	file = Open((CONST_STRPTR)cue_path, MODE_OLDFILE);
+	if (file == ZERO)
+		return FALSE;
+
+	size = get_file_size(file);
+	if (size <= 0 || size > MAX_CUE_SIZE)
+		goto cleanup;
+
+	text = malloc(size + 1);
+	if (text == NULL)
+		goto cleanup;
+
+	if (Read(file, text, size) != size)
+		goto cleanup;
+
+	text[size] = '\0';
+
+	for (line = text; *line != '\0'; line = end) {
+		end = line + strcspn(line, "\r\n");
+		if (*end != '\0')
+			*end++ = '\0';
+
+		if (!parse_cue_line(ib, cue_path, line))
+			goto cleanup;
+	}
+
+	result = finish_image(ib);
+
+cleanup:
+	free(text);
+	Close(file);
+
+	return result;
+}
+
+static BOOL has_suffix(const char *path, const char *suffix) {
+	size_t len = strlen(path);
+	size_t suffix_len = strlen(suffix);
+
+	return (len >= suffix_len && strcasecmp(path + len - suffix_len, suffix) == 0);
+}
+
+/* Opens a cue sheet, or a WAV file or raw CD audio as a single track */
+struct CDImage *open_cd_image(const char *path) {
+	struct CDImage      *ci;
+	struct ImageBuilder  ib;
+	BOOL                 result;
+
+	ci = alloc_shared_mem(sizeof(*ci));
+	if (ci == NULL)
+		return NULL;
+
+	memset(ci, 0, sizeof(*ci));
+	memset(&ib, 0, sizeof(ib));
+
+	ib.ib_Image = ci;
+	ib.ib_Track = -1;
+
+	if (has_suffix(path, ".cue")) {
+		result = parse_cue_sheet(&ib, path);
+	} else {
+		ib.ib_SectorSize = CDDA_FRAME_SIZE;
+
+		result = add_image_file(&ib, path, has_suffix(path, ".wav") ? IMAGE_WAVE : IMAGE_BINARY) &&
+			add_image_track(&ib, TRACK_CDDA, CDDA_FRAME_SIZE) &&
+			add_image_index(&ib, 1, 0) &&
+			finish_image(&ib);
+	}
+
+	if (!result) {
+		close_cd_image(ci);
+		return NULL;
+	}
+
+	return ci;
+}
+
+void close_cd_image(struct CDImage *ci) {
+	int i;
+
+	if (ci != NULL) {
+		for (i = 0; i < ci->ci_NumFiles; i++) {
+#ifdef HAVE_MMAP
+			if (ci->ci_File[i].if_Map != NULL)
+				munmap(ci->ci_File[i].if_Map, ci->ci_File[i].if_MapSize);
+#endif
+
+			if (ci->ci_File[i].if_File != ZERO)
+				Close(ci->ci_File[i].if_File);
+		}
+
+		free_shared_mem(ci, sizeof(*ci));
+	}
+}
+
+/* Segment that addr is in, NULL if it's before the first one, and the
+ * sector the next one starts at */
+static const struct CDImageSegment *find_segment(const struct CDImage *ci, LONG addr, LONG *end) {
+	const struct CDImageSegment *seg = NULL;
+	int                          i;
+
+	for (i = 0; i < ci->ci_NumSegments && ci->ci_Segment[i].is_Addr <= addr; i++)
+		seg = &ci->ci_Segment[i];
+
+	if (i < ci->ci_NumSegments)
+		*end = ci->ci_Segment[i].is_Addr;
+	else
+		*end = ci->ci_TOC.toc_Addr[ci->ci_TOC.toc_NumTracks];
+
+	return seg;
+}
+
+/* Audio sectors of the segment that are in the file from addr on, up to
+ * frames of them */
+static int segment_frames(const struct CDImage *ci, const struct CDImageSegment *seg, LONG addr, int frames,
+	ULONG *offset)
+{
+	const struct CDImageFile *cif;
+	ULONG                     avail = 0;
+
+	if (seg == NULL || seg->is_File < 0 || seg->is_SectorSize != CDDA_FRAME_SIZE)
+		return 0;
+
+	cif     = &ci->ci_File[seg->is_File];
+	*offset = seg->is_Offset + (addr - seg->is_Addr) * CDDA_FRAME_SIZE;
+
+	if (*offset < cif->if_DataSize)
+		avail = (cif->if_DataSize - *offset) / CDDA_FRAME_SIZE;
+
+	return (avail < frames) ? avail : frames;
+}
+
+/* Same as READ CD for audio sectors. Each segment is read with a single
+ * Read(), and there's no Seek() as long as the reads are sequential.
+ * Sectors that aren't in the image read as silence. */
+BOOL read_cd_image(struct CDImage *ci, LONG addr, int frames, UWORD *buffer) {
+	const struct CDImageSegment *seg;
+	struct CDImageFile          *cif;
+	UBYTE                       *dst = (UBYTE *)buffer;
+	LONG                         end;
+	ULONG                        offset, size;
+	int                          count, avail;
+
+	while (frames > 0) {
+		seg = find_segment(ci, addr, &end);
+
+		count = frames;
+		if (end > addr && count > end - addr)
+			count = end - addr;
+
+		avail = segment_frames(ci, seg, addr, count, &offset);
+		if (avail > 0) {
+			cif  = &ci->ci_File[seg->is_File];
+			size = avail * CDDA_FRAME_SIZE;
+
+			if (cif->if_Map != NULL) {
+				memcpy(dst, cif->if_Map + cif->if_DataStart + offset, size);
+			} else {
+				if (cif->if_Pos != offset &&
+					Seek(cif->if_File, cif->if_DataStart + offset, OFFSET_BEGINNING) == -1)
+				{
+					cif->if_Pos = ~0;
+					return FALSE;
+				}
+
+				if (Read(cif->if_File, dst, size) != size) {
+					cif->if_Pos = ~0;
+					return FALSE;
+				}
+
+				cif->if_Pos = offset + size;
+			}
+
+			if (cif->if_Swap)
+				swap_samples_scalar(dst, dst, size);
+		}
+
+		memset(dst + avail * CDDA_FRAME_SIZE, 0, (count - avail) * CDDA_FRAME_SIZE);
+
+		dst    += count * CDDA_FRAME_SIZE;
+		addr   += count;
+		frames -= count;
+	}
+
+	return TRUE;
+}
+
+/* The sectors from addr on as a pointer into the mapped image, without
+ * copying. Stops at the end of the segment, so count may be less than
+ * frames. NULL if they have to be read with read_cd_image(). The data
+ * must not be written to. */
+UWORD *map_cd_image(struct CDImage *ci, LONG addr, int frames, int *count) {
+	const struct CDImageSegment *seg;
+	const struct CDImageFile    *cif;
+	LONG                         end;
+	ULONG                        offset;
+
+	seg = find_segment(ci, addr, &end);
+	if (seg == NULL || seg->is_File < 0)
+		return NULL;
+
+	cif = &ci->ci_File[seg->is_File];
+	if (cif->if_Map == NULL || cif->if_Swap)
+		return NULL;
+
+	if (end > addr && frames > end - addr)
+		frames = end - addr;
+
+	*count = segment_frames(ci, seg, addr, frames, &offset);
+	if (*count == 0)
+		return NULL;
+
+	return (UWORD *)(cif->if_Map + cif->if_DataStart + offset);
+}
@@ -103,6 +103,16 @@ static BOOL get_icon(struct PlayCDDAData *pcd, int argc, char **argv) {
 	return (pcd->pcd_Icon != NULL);
 }
 
+static LONG get_tooltype_number(struct PlayCDDAData *pcd, const char *name, LONG def_value) {
+	STRPTR value;
+
+	value = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)name);
+	if (value == NULL)
+		return def_value;
+
+	return strtol((const char *)value, NULL, 0);
+}
+
 static void free_icon(struct PlayCDDAData *pcd) {
 	if (pcd->pcd_Icon != NULL)
 		FreeDiskObject(pcd->pcd_Icon);
@@ -117,6 +127,8 @@ static void free_icon(struct PlayCDDAData *pcd) {
 int main(int argc, char **argv) {
 	struct PlayCDDAData *pcd;
 	struct CDROMDrive *cdd;
+	STRPTR value;
+	LONG rate;
 	int rc = RETURN_ERROR;
 
 	pcd = alloc_shared_mem(sizeof(*pcd));
@@ -125,6 +137,9 @@ int main(int argc, char **argv) {
 
 	memset(pcd, 0, sizeof(*pcd));
 
+	pcd->pcd_DCSignal     = -1;
+	pcd->pcd_StatusSignal = -1;
+
 	pcd->pcd_MainProc = (struct Process *)FindTask(NULL);
 
 	open_catalog(pcd, "PlayCDDA.catalog");
@@ -132,6 +147,11 @@ int main(int argc, char **argv) {
 	if (!get_icon(pcd, argc, argv))
 		goto cleanup;
 
+	if (!open_timer(pcd))
+		goto cleanup;
+
+	init_convert(pcd);
+
 	if (!open_ahi(pcd))
 		goto cleanup;
 
@@ -139,9 +159,18 @@ int main(int argc, char **argv) {
 	if (pcd->pcd_DCSignal == -1)
 		goto cleanup;
 
+	pcd->pcd_StatusSignal = AllocSignal(-1);
+	if (pcd->pcd_StatusSignal == -1)
+		goto cleanup;
+
 	if (!get_cdrom_drives(pcd, &pcd->pcd_CDDrives))
 		goto cleanup;
 
+	/* Disc images, listed as drives */
+	value = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"DISCIMAGE");
+	if (value != NULL && !add_image_drives(pcd, &pcd->pcd_CDDrives, (const char *)value))
+		goto cleanup;
+
 	if (IsListEmpty(&pcd->pcd_CDDrives))
 		goto cleanup;
 
@@ -152,28 +181,80 @@ int main(int argc, char **argv) {
 	if (cdd == NULL)
 		cdd = (struct CDROMDrive *)GetHead(&pcd->pcd_CDDrives);
 
-	if (!open_cdrom_drive(pcd, cdd))
+	/* Titles, built by FreeDBImport */
+	value = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"FREEDB");
+	if (value != NULL)
+		strlcpy(pcd->pcd_FreeDB, (const char *)value, sizeof(pcd->pcd_FreeDB));
+
+	/* Drives are only opened and read from the drive process */
+	if (!start_drive_proc(pcd))
+		goto cleanup;
+
+	if (!do_drive_command(pcd, PCC_OPENDRIVE, (pcm_arg_t)cdd))
 		goto cleanup;
 
+	/* Usually back from the disc info file before the window is open */
+	send_drive_command(pcd, PCC_READTOC, 0);
+
 	set_volume(pcd, 64); /* Full volume */
 
+	pcd->pcd_PlayerData.pcpd_NumCDDABufs   = get_tooltype_number(pcd, "READBUFFERS", CDDA_NUM_BUFS);
+	pcd->pcd_PlayerData.pcpd_ReadBudget    = get_tooltype_number(pcd, "READBUFFERMEM", CDDA_READ_BUDGET / 1024) * 1024;
+	pcd->pcd_PlayerData.pcpd_OutputLatency = get_tooltype_number(pcd, "OUTPUTLATENCY", OUTPUT_LATENCY);
+
+	pcd->pcd_PlayerData.pcpd_InstantStart    = get_tooltype_number(pcd, "INSTANTSTART", INSTANT_START_SECS);
+	pcd->pcd_PlayerData.pcpd_InstantStartMem = get_tooltype_number(pcd, "INSTANTSTARTMEM", INSTANT_START_MEM / 1024) * 1024;
+	pcd->pcd_PlayerData.pcpd_CacheDiscMem    = get_tooltype_number(pcd, "CACHEDISCMEM", CACHE_DISC_MEM / 1024) * 1024;
+
+	pcd->pcd_PlayerData.pcpd_CacheDisc   = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"CACHEDISC") != NULL;
+	pcd->pcd_PlayerData.pcpd_CachePacked = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"PACKCACHE") != NULL;
+
+	value = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"DISKCACHE");
+	if (value != NULL)
+		strlcpy(pcd->pcd_PlayerData.pcpd_DiskCacheDir, (const char *)value, sizeof(pcd->pcd_PlayerData.pcpd_DiskCacheDir));
+
+	pcd->pcd_PlayerData.pcpd_DiskCacheSize = get_tooltype_number(pcd, "DISKCACHESIZE", DISK_CACHE_SIZE);
+
+	rate = get_tooltype_number(pcd, "STATUSRATE", STATUS_RATE);
+	if (rate <= 0)
+		rate = STATUS_RATE;
+
+	pcd->pcd_PlayerData.pcpd_StatusInterval = 1000000 / rate;
+
+	pcd->pcd_PlayerData.pcpd_SoftVolume = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"SOFTVOLUME") != NULL;
+
+	value = FindToolType((STRPTR *)pcd->pcd_Icon->do_ToolTypes, (CONST_STRPTR)"DRIVESPEED");
+	if (value != NULL && MatchToolValue(value, (CONST_STRPTR)"MAX"))
+		pcd->pcd_PlayerData.pcpd_SpeedMode = SPEED_MAX;
+	else
+		pcd->pcd_PlayerData.pcpd_SpeedMode = SPEED_GOVERNED;
+
 	if (!create_gui(pcd))
 		goto cleanup;
 
+	if (!start_player_proc(pcd))
+		goto cleanup;
+
 	rc = main_loop(pcd);
 
 cleanup:
 	if (pcd != NULL) {
+		kill_player_proc(pcd);
+
 		destroy_gui(pcd);
 
-		close_cdrom_drive(pcd);
+		/* Closes the drive */
+		stop_drive_proc(pcd);
 
 		free_cdrom_drives(pcd, &pcd->pcd_CDDrives);
 
+		FreeSignal(pcd->pcd_StatusSignal);
 		FreeSignal(pcd->pcd_DCSignal);
 
 		close_ahi(pcd);
 
+		close_timer(pcd);
+
 		free_icon(pcd);
 
 		close_catalog(pcd);
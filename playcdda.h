@@ -31,6 +31,7 @@
 
 #ifdef __amigaos4__
 #define __USE_INLINE__
+#define __USE_OLD_TIMEVAL__
 #define DEFAULT_CODESET 4
 #endif
 
@@ -39,14 +40,20 @@
 #endif
 
 #include <devices/ahi.h>
+#include <devices/trackdisk.h>
 #include <proto/exec.h>
 #include <proto/dos.h>
 #include <proto/locale.h>
 #include <proto/icon.h>
+#include <proto/timer.h>
 
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(__amigaos4__) && !defined(__AROS__)
+typedef unsigned long long UQUAD;
+#endif
+
 #ifdef __amigaos4__
 #include "gui_reaction.h"
 #else
@@ -55,30 +62,101 @@
 
 #define CDDA_FRAME_SIZE 2352
 
-#define CDDA_BUF_FRAMES 150
-#define CDDA_BUF_SIZE   (CDDA_BUF_FRAMES*CDDA_FRAME_SIZE)
+/* Sectors per READ CD, adjusted at runtime between these limits */
+#define CDDA_MIN_FRAMES   16
+#define CDDA_MAX_FRAMES   300
+#define CDDA_START_FRAMES 75
+
+#define CDDA_NUM_BUFS   4
+#define MAX_CDDA_BUFS   16
+
+/* Default memory budget for all CDDA read buffers */
+#ifdef __mc68000__
+#define CDDA_READ_BUDGET (256*1024)
+#else
+#define CDDA_READ_BUDGET (2*1024*1024)
+#endif
 
+#define CDDA_FRAMES_PER_SEC 75
+
+/* Default seconds from the start of every track kept in RAM, and the
+ * memory for them */
+#define INSTANT_START_SECS 2
+#ifdef __mc68000__
+#define INSTANT_START_MEM (1024*1024)
+#else
+#define INSTANT_START_MEM (12*1024*1024)
+#endif
+
+/* Default memory for caching the whole disc, a full CD needs about 800 MB */
+#ifdef __mc68000__
+#define CACHE_DISC_MEM (16*1024*1024)
+#else
+#define CACHE_DISC_MEM (256*1024*1024)
+#endif
+
+/* Sectors per independently packed block of the cache, and the size of a
+ * packed block relative to the raw one that the layout plans for */
+#define CACHE_BLOCK_FRAMES   4
+#define CACHE_PACKED_PERCENT 70
+
+/* Default size limit for all files in the sector cache directory, in MB */
+#ifdef __mc68000__
+#define DISK_CACHE_SIZE 256
+#else
+#define DISK_CACHE_SIZE 2048
+#endif
+
+/* Preferred sectors per AHI write */
 #define PCM_BUF_FRAMES  5
-#define PCM_BUF_SIZE    (PCM_BUF_FRAMES*CDDA_FRAME_SIZE)
+
+/* Target output latency in ms, split across up to MAX_AHI_BUFS linked writes */
+#define OUTPUT_LATENCY     200
+#define MIN_OUTPUT_LATENCY 30
+#define MAX_OUTPUT_LATENCY 2000
+#define MAX_AHI_BUFS       32
 
 #define PLAYER_PROC_PRI 5
 
+/* Asynchronous commands that can be in flight at once */
+#define PLAYER_CMD_MSGS 8
+
 #ifdef __amigaos4__
 #define CurrentDir(dir) SetCurrentDir(dir)
+#define SetFileDate(name, date) SetDate(name, date)
 #endif
 
 #define MAX_DRIVES 32
 #define MAX_TRACKS 32
 
+/* MMC features from GET CONFIGURATION */
+#define CDF_KNOWN    (1UL << 0) /* The drive answered, the others are valid */
+#define CDF_READCD   (1UL << 1) /* CD Read */
+#define CDF_CDTEXT   (1UL << 2)
+#define CDF_C2       (1UL << 3) /* C2 error pointers */
+#define CDF_SETSPEED (1UL << 4) /* Real Time Streaming with SET CD SPEED */
+
+#define MAX_NSD_COMMANDS 32
+
+/* What a drive can do, found out once when it's probed */
+struct CDROMCaps {
+	UWORD                cap_Commands[MAX_NSD_COMMANDS + 1]; /* Empty if it isn't an NSD device */
+	struct DriveGeometry cap_Geometry;
+	ULONG                cap_Features;
+};
+
 struct CDROMDrive {
-	struct Node  cdd_Node;
-	CONST_STRPTR cdd_Device;
-	ULONG        cdd_Unit;
-	ULONG        cdd_Flags;
+	struct Node      cdd_Node;
+	CONST_STRPTR     cdd_Device;
+	ULONG            cdd_Unit;
+	ULONG            cdd_Flags;
+	CONST_STRPTR     cdd_Image;  /* Disc image to use instead, NULL for a real drive */
+	struct CDROMCaps cdd_Caps;
 };
 
 struct PlayCDDATOC {
 	UBYTE toc_NumTracks;
+	UBYTE toc_SessionTrack; /* First track of the last session, 0 if there's only one */
 	UBYTE toc_Type[MAX_TRACKS + 1];
 	ULONG toc_Addr[MAX_TRACKS + 1];
 };
@@ -89,13 +167,70 @@ enum {
 	TRACK_DATA
 };
 
+/* What is kept about a disc between runs, see discinfo.c */
+struct DiscInfo {
+	ULONG              di_DiscID;   /* FreeDB disc ID */
+	struct PlayCDDATOC di_TOC;
+	LONG               di_LastAddr; /* Where playing got to, -1 if it hasn't been played */
+};
+
+/* Titles from the offline FreeDB database, see freedb.c. The strings are
+ * kept as offsets, so that it can be copied. */
+#define MAX_TITLE_LEN   64 /* With the NUL */
+#define MAX_TITLES_SIZE (1 + (MAX_TRACKS + 1) * MAX_TITLE_LEN)
+
+struct DiscTitles {
+	int   dt_NumTracks;         /* 0 if the disc wasn't found */
+	UWORD dt_Track[MAX_TRACKS]; /* Offsets of the track titles in dt_Text */
+	char  dt_Text[MAX_TITLES_SIZE]; /* Disc title first */
+};
+
+/* A disc image that stands in for a drive. The sectors of the TOC are
+ * mapped onto the image files in segments, anything that isn't in a file
+ * (PREGAP, the end of a short file) reads as silence.
+ */
+#define MAX_IMAGE_FILES    MAX_TRACKS
+#define MAX_IMAGE_SEGMENTS (MAX_TRACKS * 2)
+
+struct CDImageFile {
+	BPTR   if_File;
+	ULONG  if_DataStart;  /* Past the WAV header */
+	ULONG  if_DataSize;
+	ULONG  if_Pos;        /* Read position from if_DataStart, ~0 if unknown */
+	BOOL   if_Swap;       /* Big endian samples */
+	UBYTE *if_Map;        /* Whole file, if it could be mapped */
+	ULONG  if_MapSize;
+};
+
+struct CDImageSegment {
+	LONG  is_Addr;       /* Sector the segment starts at */
+	int   is_File;
+	ULONG is_Offset;     /* Of is_Addr, from if_DataStart */
+	ULONG is_SectorSize;
+};
+
+struct CDImage {
+	struct PlayCDDATOC    ci_TOC;
+	int                   ci_NumFiles;
+	struct CDImageFile    ci_File[MAX_IMAGE_FILES];
+	int                   ci_NumSegments;
+	struct CDImageSegment ci_Segment[MAX_IMAGE_SEGMENTS];
+};
+
 typedef enum {
 	PCC_INVALID,
 	PCC_STARTUP,
-	PCC_PLAY,
+	PCC_PLAY,     /* Arg1 = start address, Arg2 = end address */
 	PCC_PAUSE,
 	PCC_STOP,
-	PCC_DIE
+	PCC_DIE,
+	PCC_SETVOLUME, /* Arg1 = volume (0-64) */
+	PCC_SEEK,      /* Arg1 = address to continue playing from */
+	PCC_PREFETCH,  /* Refill the cache after a new TOC has been read */
+	PCC_OPENDRIVE, /* Drive process, Arg1 = struct CDROMDrive * */
+	PCC_READTOC,   /* Drive process, into pcdd_Disc */
+	PCC_CHECKDISC, /* Drive process, PCC_READTOC if the disc has changed */
+	PCC_MAX
 } pcm_command_t;
 
 #ifdef __AROS__
@@ -115,59 +250,289 @@ struct PlayCDDAMsg {
 	BOOL                 pcm_Result;
 };
 
+enum {
+	PS_STOPPED,
+	PS_PLAYING,
+	PS_PAUSED
+};
+
+/* Published by the player, read with get_player_status() */
+struct PlayCDDAStatus {
+	int   ps_State;
+	LONG  ps_Addr;     /* Sector being played */
+	int   ps_Track;    /* Index into pcd_TOC, -1 if stopped */
+	int   ps_Index;    /* Always 1, index points aren't in the TOC */
+	ULONG ps_Buffered; /* Sectors read ahead of ps_Addr */
+	ULONG ps_Cached;   /* Sectors in the cache so far */
+	ULONG ps_CacheSize; /* Sectors the cache will hold for this disc */
+};
+
+/* Time for a drive to settle after a disc change interrupt before it's
+ * checked, as some send several for one change */
+#define DISC_SETTLE_MS 500
+
+/* Default maximum GUI updates per second */
+#define STATUS_RATE 10
+
+/* Latest arguments for a coalesced command, sent when the one in flight
+ * is replied */
+struct PlayCDDAPendingCmd {
+	BOOL      pc_Pending;
+	pcm_arg_t pc_Arg1;
+	pcm_arg_t pc_Arg2;
+};
+
 #ifdef __amigaos4__
 typedef ULONG           pcpd_proc_id_t;
 #else
 typedef struct Process *pcpd_proc_id_t;
 #endif
 
+enum {
+	SPEED_GOVERNED, /* Lowest speed that keeps the read buffers filled */
+	SPEED_MAX       /* For ripping or caching */
+};
+
+struct PlayCDDAPlayerStats {
+	ULONG pcps_FramesRead;
+	ULONG pcps_ReadTime;   /* Microseconds spent playing */
+	ULONG pcps_ReadRate;   /* Bytes per second */
+	ULONG pcps_Underruns;  /* Times the output had to wait for a read */
+	ULONG pcps_ReadErrors;
+	ULONG pcps_ReadFrames;  /* Current sectors per READ CD */
+	ULONG pcps_ReadLatency; /* Average time per READ CD in microseconds */
+	ULONG pcps_DriveRate;   /* Bytes per second at the current transfer size */
+	ULONG pcps_DriveSpeed;  /* Requested read speed in kB/s, 0xFFFF = maximum */
+	ULONG pcps_OutputLatency; /* Audio queued to AHI when full, in ms */
+	ULONG pcps_MaxWriteGap;   /* Worst time from a finished AHI write to its resubmission (us) */
+	ULONG pcps_Seeks;
+	ULONG pcps_SeekHits;      /* Seeks served from data already in the ring */
+	ULONG pcps_SeekLatency;   /* Last seek to first audio sent to AHI (us) */
+	ULONG pcps_MaxSeekLatency;
+	ULONG pcps_CacheHits;     /* Plays started from the cache */
+	ULONG pcps_CacheMisses;
+	ULONG pcps_StartLatency;  /* Last play command to first audio sent to AHI (us) */
+	ULONG pcps_CacheRaw;      /* Bytes packed into the cache */
+	ULONG pcps_CachePacked;   /* What they take up there */
+	ULONG pcps_Unpacked;      /* Bytes the player unpacked from the cache */
+	ULONG pcps_UnpackTime;    /* Microseconds spent on it */
+	ULONG pcps_UnpackRate;    /* Bytes unpacked per second */
+	ULONG pcps_DiskCacheHits; /* Sectors read from the sector cache file */
+	ULONG pcps_DiskCacheStored; /* Sectors added to it */
+	ULONG pcps_ImageMapped;   /* Bytes played straight from a mapped disc image */
+	ULONG pcps_ImageCopied;   /* Bytes read or copied from a disc image */
+	ULONG pcps_ImageTime;     /* Microseconds the reader spent on either */
+};
+
+/* Single producer, single consumer ring between the reader and the player
+ * process. Only the reader writes cr_Head and only the player writes cr_Tail,
+ * so no locking is needed, just a barrier before either one is advanced.
+ */
+struct CDDARingSlot {
+	UWORD         *rs_Buffer;
+	UWORD         *rs_Data;       /* rs_Buffer, or into a mapped disc image */
+	LONG           rs_Addr;
+	int            rs_Frames;
+	ULONG          rs_Generation; /* cr_Generation the read was made for */
+};
+
+struct CDDARing {
+	volatile ULONG  cr_Head;       /* Slots published by the reader */
+	volatile ULONG  cr_Tail;       /* Slots released by the player */
+	volatile LONG   cr_StartAddr;  /* Range to read, set by the player */
+	volatile LONG   cr_EndAddr;
+	volatile ULONG  cr_Generation; /* Bumped by the player on every new range */
+	volatile ULONG  cr_DiscGeneration; /* Bumped by the player after a new TOC has been read */
+	volatile ULONG  cr_Failed;     /* Generation the reader gave up on */
+	volatile BOOL   cr_Quit;
+
+	struct Task * volatile cr_ReaderTask;
+	ULONG           cr_ReaderSig;
+	struct Task    *cr_PlayerTask;
+	ULONG           cr_PlayerSig;
+
+	int             cr_NumSlots;
+	int             cr_SlotFrames;
+	struct CDDARingSlot cr_Slot[MAX_CDDA_BUFS];
+
+	struct CDDACache *cr_Cache;    /* NULL if disabled */
+};
+
+/* Audio kept in RAM so that playback can start without waiting for the
+ * drive, or can do without it altogether once the whole disc is cached.
+ * The reader fills the extents while it has nothing else to read and sets
+ * ce_Generation once an extent is complete. The player bumps cc_Generation
+ * to have the extents laid out again for a new disc.
+ */
+struct CDDACacheExtent {
+	LONG           ce_Addr;
+	int            ce_Frames;
+	int            ce_Done;       /* Frames read so far, reader only */
+	volatile int   ce_Ready;      /* Frames from ce_Addr on the player can use */
+	UWORD         *ce_Data;
+	ULONG         *ce_Blocks;     /* Offset of every packed block in cc_Mem */
+	volatile ULONG ce_Generation; /* cc_Generation the layout is for */
+};
+
+struct CDDACache {
+	volatile ULONG cc_Generation;
+	int            cc_IntroFrames; /* Frames every track gets first */
+	BOOL           cc_WholeDisc;   /* Then as much of each track as fits */
+	BOOL           cc_Packed;      /* Losslessly packed in blocks */
+	UBYTE         *cc_Mem;
+	ULONG          cc_MemSize;
+	ULONG          cc_Used;        /* Reader only */
+	volatile ULONG cc_FramesDone;  /* Progress, for the status */
+	ULONG          cc_FramesTotal;
+	BOOL           cc_Complete;    /* Every audio frame has an extent */
+	struct PlayCDDATOC cc_TOC;     /* The extents were laid out for */
+	int            cc_NumExtents;
+	struct CDDACacheExtent cc_Extent[MAX_TRACKS];
+};
+
+/* Sectors already read, kept in a file per disc so that they don't have
+ * to be read from the drive again the next time the disc is inserted.
+ * The file starts with a header and an index that has the file offset of
+ * every chunk of sectors, followed by the chunks in the order they were
+ * read. Only the reader uses it.
+ */
+struct DiskCache {
+	BPTR               dc_File;
+	const char        *dc_Dir;
+	char               dc_Name[16];  /* From the disc fingerprint */
+	UQUAD              dc_MaxSize;   /* For all files in dc_Dir */
+	struct PlayCDDATOC dc_TOC;
+	ULONG              dc_NumChunks;
+	ULONG             *dc_Index;     /* 0 if the chunk isn't in the file */
+	ULONG              dc_FileSize;
+	ULONG              dc_Written;   /* Bytes added since the last eviction */
+	BOOL               dc_Full;      /* Nothing more is added */
+};
+
+#if defined(__PPC__) || defined(__powerpc__)
+#define MEMORY_BARRIER() __asm__ __volatile__("sync" ::: "memory")
+#else
+#define MEMORY_BARRIER() __asm__ __volatile__("" ::: "memory")
+#endif
+
+#define READER_PROC_PRI 4
+
+#define DRIVE_PROC_PRI 0
+
+/* The drive process and the one command that it can have at a time */
+struct PlayCDDADriveData {
+	struct Process     *pcdd_Process;
+	struct MsgPort     *pcdd_ReplyPort;
+	struct PlayCDDAMsg  pcdd_CmdMsg;
+	BOOL                pcdd_Busy;       /* pcdd_CmdMsg hasn't come back yet */
+	pcm_command_t       pcdd_Pending;    /* To send once it has, PCC_INVALID if none */
+	pcm_arg_t           pcdd_PendingArg;
+	struct DiscInfo     pcdd_Disc;       /* From the last PCC_READTOC */
+	struct DiscTitles   pcdd_Titles;     /* Of pcdd_Disc */
+	BOOL                pcdd_HaveChangeCount;
+	ULONG               pcdd_ChangeCount; /* Drive's disc change count for pcdd_Disc */
+	BOOL                pcdd_Switching;  /* Timing a change of drive */
+	ULONG               pcdd_SwitchStart;
+};
+
 struct PlayCDDAPlayerData {
 	Fixed              pcpd_Volume;
+	int                pcpd_NumCDDABufs;
+	ULONG              pcpd_ReadBudget;
+	int                pcpd_SpeedMode;
+	int                pcpd_OutputLatency; /* ms */
+	BOOL               pcpd_SoftVolume;    /* Apply pcpd_Volume ourselves instead of AHI */
+	int                pcpd_InstantStart;  /* Seconds of every track to cache, 0 = off */
+	ULONG              pcpd_InstantStartMem;
+	BOOL               pcpd_CacheDisc;     /* Cache all of the audio */
+	ULONG              pcpd_CacheDiscMem;
+	BOOL               pcpd_CachePacked;   /* Pack the cache to fit more in */
+	char               pcpd_DiskCacheDir[256]; /* Empty = no sector cache on disk */
+	ULONG              pcpd_DiskCacheSize; /* MB */
+
+	struct PlayCDDAPlayerStats pcpd_Stats;
+
+	/* Odd while the player is writing pcpd_Status */
+	volatile ULONG        pcpd_StatusSeq;
+	struct PlayCDDAStatus pcpd_Status;
+	ULONG                 pcpd_StatusInterval; /* Minimum time between signals (us) */
 
 	struct MsgPort     pcpd_ReplyPort;
 	struct PlayCDDAMsg pcpd_PlayerMsg;
+	struct PlayCDDAMsg pcpd_CmdMsg[PLAYER_CMD_MSGS];
+
+	struct PlayCDDAPendingCmd pcpd_Pending[PCC_MAX];
 
 	pcpd_proc_id_t     pcpd_ProcessID;
 };
 
+/* Converts size bytes of CDDA samples from src to dst */
+typedef void (*convert_func_t)(const void *src, void *dst, ULONG size);
+/* Same, with a Q16 gain that changes by step after every sample frame */
+typedef void (*scale_func_t)(const void *src, void *dst, ULONG size, LONG gain, LONG step);
+
 struct PlayCDDAData {
 	struct Process           *pcd_MainProc;
 
 	struct Library           *pcd_LocaleBase;
 	struct Library           *pcd_IconBase;
+	struct Device            *pcd_TimerBase;
 
 #ifdef __amigaos4__
 	struct LocaleIFace       *pcd_ILocale;
 	struct IconIFace         *pcd_IIcon;
+	struct TimerIFace        *pcd_ITimer;
 #endif
 
 	struct Catalog           *pcd_Catalog;
 
 	struct DiskObject        *pcd_Icon;
 
+	struct MsgPort           *pcd_TimerPort;
+	struct timerequest       *pcd_TimerReq;
+	struct timerequest       *pcd_AlarmReq;
+	BOOL                      pcd_AlarmBusy;
+	ULONG                     pcd_EClockFreq;
+
+	convert_func_t            pcd_SwapSamples;
+	scale_func_t              pcd_ScaleSamples;
+
 	struct MsgPort           *pcd_AHIPort;
 	struct AHIRequest        *pcd_AHIReq;
 
 	struct List               pcd_CDDrives;
 	struct CDROMDrive        *pcd_CurrentDrive;
+	ULONG                     pcd_SwitchTime; /* Last change of drive until the disc was read (us) */
 
 	struct MsgPort           *pcd_CDPort;
-	struct IOStdReq          *pcd_CDReq;
+	struct IOStdReq          *pcd_CDReq;   /* Not opened for a disc image */
+	struct CDImage           *pcd_Image;
 
 	BYTE                      pcd_DCSignal;
 	struct Interrupt         *pcd_DCInterrupt;
 	struct IOStdReq          *pcd_DCReq;
 
+	struct PlayCDDATOC        pcd_TOC;
+	struct DiscInfo           pcd_DiscInfo; /* Disc in pcd_TOC, the GUI keeps di_LastAddr up to date */
+	struct DiscTitles         pcd_Titles;
+	char                      pcd_FreeDB[256]; /* Offline FreeDB database, empty = none */
+
+	BYTE                      pcd_StatusSignal;
+
 	struct PlayCDDAGUI        pcd_GUIData;
 
 	struct PlayCDDAPlayerData pcd_PlayerData;
+
+	struct PlayCDDADriveData  pcd_DriveData;
 };
 
 #define LocaleBase (pcd->pcd_LocaleBase)
 #define IconBase   (pcd->pcd_IconBase)
+#define TimerBase  (pcd->pcd_TimerBase)
 
 #define ILocale    (pcd->pcd_ILocale)
 #define IIcon      (pcd->pcd_IIcon)
+#define ITimer     (pcd->pcd_ITimer)
 
 extern const char verstag[];
 
@@ -185,21 +550,99 @@ void delete_iorequest(struct IORequest *ioreq);
 struct IORequest *copy_iorequest(const struct IORequest *original);
 void delete_iorequest_copy(struct IORequest *ioreq);
 
+BOOL open_timer(struct PlayCDDAData *pcd);
+void close_timer(struct PlayCDDAData *pcd);
+ULONG get_time_us(struct PlayCDDAData *pcd);
+void set_alarm(struct PlayCDDAData *pcd, ULONG ms);
+void stop_alarm(struct PlayCDDAData *pcd);
+BOOL check_alarm(struct PlayCDDAData *pcd);
+ULONG get_alarm_signal(const struct PlayCDDAData *pcd);
+
+void init_convert(struct PlayCDDAData *pcd);
+void swap_samples_scalar(const void *src, void *dst, ULONG size);
+void scale_samples_scalar(const void *src, void *dst, ULONG size, LONG gain, LONG step);
+#ifdef __amigaos4__
+void swap_samples_altivec(const void *src, void *dst, ULONG size);
+void scale_samples_altivec(const void *src, void *dst, ULONG size, LONG gain, LONG step);
+#endif
+#if defined(__i386__) || defined(__x86_64__)
+void scale_samples_sse2(const void *src, void *dst, ULONG size, LONG gain, LONG step);
+#endif
+
 BOOL open_ahi(struct PlayCDDAData *pcd);
 void close_ahi(struct PlayCDDAData *pcd);
 void play_pcm_data(struct PlayCDDAData *pcd, const WORD *pcm_data, ULONG pcm_size);
 void stop_playback(struct PlayCDDAData *pcd, BOOL force);
 
 BOOL get_cdrom_drives(struct PlayCDDAData *pcd, struct List *list);
+BOOL add_image_drives(struct PlayCDDAData *pcd, struct List *list, const char *paths);
 void free_cdrom_drives(struct PlayCDDAData *pcd, struct List *list);
 BOOL open_cdrom_drive(struct PlayCDDAData *pcd, struct CDROMDrive *cdd);
 void close_cdrom_drive(struct PlayCDDAData *pcd);
 BOOL read_toc(struct PlayCDDAData *pcd, struct PlayCDDATOC *toc);
+BOOL get_disc_change_count(struct PlayCDDAData *pcd, ULONG *count);
+void read_disc_id(struct PlayCDDAData *pcd, int *tracks, LONG *leadout);
+BOOL get_audio_run(const struct PlayCDDATOC *toc, LONG addr, LONG *start_addr, LONG *end_addr);
+BOOL get_play_range(const struct PlayCDDATOC *toc, int track, LONG *start_addr, LONG *end_addr);
+
+BOOL find_disc_info(const struct PlayCDDATOC *toc, struct DiscInfo *di);
+void store_disc_info(const struct DiscInfo *di);
+
+ULONG get_freedb_id(const struct PlayCDDATOC *toc);
+BOOL find_disc_titles(const char *path, const struct PlayCDDATOC *toc, struct DiscTitles *dt);
+const char *get_disc_title(const struct DiscTitles *dt);
+const char *get_track_title(const struct DiscTitles *dt, int track);
+
+struct CDImage *open_cd_image(const char *path);
+void close_cd_image(struct CDImage *ci);
+BOOL read_cd_image(struct CDImage *ci, LONG addr, int frames, UWORD *buffer);
+UWORD *map_cd_image(struct CDImage *ci, LONG addr, int frames, int *count);
 
 BOOL create_gui(struct PlayCDDAData *pcd);
 void destroy_gui(struct PlayCDDAData *pcd);
 int main_loop(struct PlayCDDAData *pcd);
 
+struct CDDARing *alloc_cdda_ring(struct PlayCDDAData *pcd);
+void free_cdda_ring(struct CDDARing *ring);
+ULONG cdda_ring_fill(const struct CDDARing *ring, ULONG pos);
+
+struct CDDACache *alloc_cdda_cache(struct PlayCDDAData *pcd);
+void free_cdda_cache(struct CDDACache *cache);
+void layout_cdda_cache(struct CDDACache *cache, const struct PlayCDDATOC *toc, ULONG generation);
+UWORD *cdda_cache_target(struct CDDACache *cache, struct CDDACacheExtent *ext);
+int store_cdda_cache(struct PlayCDDAData *pcd, struct CDDACache *cache, struct CDDACacheExtent *ext,
+	const UWORD *data, int frames);
+void truncate_cdda_cache(struct CDDACache *cache, struct CDDACacheExtent *ext);
+const struct CDDACacheExtent *find_cdda_cache(const struct CDDACache *cache, LONG addr);
+const struct CDDACacheExtent *next_cdda_cache(const struct CDDACache *cache, LONG *addr);
+LONG cdda_cache_end(const struct CDDACache *cache, LONG addr);
+int read_cdda_cache(const struct CDDACache *cache, const struct CDDACacheExtent *ext, LONG addr,
+	UWORD *buf, UWORD **data);
+
+struct DiskCache *open_disk_cache(struct PlayCDDAData *pcd, const struct PlayCDDATOC *toc);
+void close_disk_cache(struct DiskCache *dc);
+int read_disk_cache(struct DiskCache *dc, LONG addr, int frames, UWORD *buffer);
+int disk_cache_miss(const struct DiskCache *dc, LONG addr, int frames);
+int write_disk_cache(struct DiskCache *dc, LONG addr, int frames, const UWORD *buffer);
+
+BOOL start_reader_proc(struct PlayCDDAData *pcd, struct CDDARing *ring);
+void stop_reader_proc(struct CDDARing *ring);
+
+BOOL start_drive_proc(struct PlayCDDAData *pcd);
+void stop_drive_proc(struct PlayCDDAData *pcd);
+BOOL do_drive_command(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg);
+void send_drive_command(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg);
+BOOL get_drive_reply(struct PlayCDDAData *pcd, pcm_command_t *command, BOOL *result);
+BOOL is_drive_reading(const struct PlayCDDAData *pcd);
+ULONG get_drive_signal(const struct PlayCDDAData *pcd);
+
+BOOL start_player_proc(struct PlayCDDAData *pcd);
+void kill_player_proc(struct PlayCDDAData *pcd);
+BOOL send_player_command(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg1, pcm_arg_t arg2);
+void handle_player_replies(struct PlayCDDAData *pcd);
+ULONG get_player_signal(const struct PlayCDDAData *pcd);
+void get_player_status(const struct PlayCDDAData *pcd, struct PlayCDDAStatus *status);
+
 void set_volume(struct PlayCDDAData *pcd, int volume);
 int get_volume(const struct PlayCDDAData *pcd);
 
@@ -33,8 +33,6 @@
 #include <clib/alib_protos.h>
 #endif
 
-#include <unistd.h>
-
 static void init_msgport(struct MsgPort *port) {
 	port->mp_Node.ln_Type = NT_MSGPORT;
 	port->mp_Flags        = PA_SIGNAL;
@@ -68,12 +66,13 @@ static void deinit_player_message(struct PlayCDDAMsg *pcm) {
 	}
 }
 
+static BOOL is_player_message(const struct PlayCDDAMsg *pcm) {
+	return (pcm->pcm_Msg.mn_Node.ln_Type == NT_MESSAGE && pcm->pcm_Msg.mn_Length == sizeof(*pcm));
+}
+
+/* pcd is the one that came with PCC_STARTUP */
 static BOOL valid_player_message(const struct PlayCDDAData *pcd, const struct PlayCDDAMsg *pcm) {
-	if (pcm->pcm_Msg.mn_Node.ln_Type == NT_MESSAGE && pcm->pcm_Msg.mn_Length == sizeof(*pcm)) {
-		if (pcm->pcm_GlobalData == pcd)
-			return TRUE;
-	}
-	return FALSE;
+	return (is_player_message(pcm) && pcm->pcm_GlobalData == pcd);
 }
 
 #ifdef __amigaos4__
@@ -178,10 +177,19 @@ static BOOL do_player_command(struct PlayCDDAData *pcd, pcm_command_t command,
 {
 	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
 	struct PlayCDDAMsg        *pcm  = &pcpd->pcpd_PlayerMsg;
+	struct PlayCDDAMsg        *reply;
+	struct PlayCDDAPendingCmd *pc;
+	ULONG                      freed = 0;
+	BOOL                       done = FALSE;
+	int                        i;
 
 	if (pcpd->pcpd_ProcessID == 0)
 		return FALSE;
 
+	/* Same as in send_player_command() */
+	if (command == PCC_STOP)
+		pcpd->pcpd_Pending[PCC_SEEK].pc_Pending = FALSE;
+
 	pcm->pcm_Command = command;
 
 	pcm->pcm_Arg1 = arg1;
@@ -194,9 +202,34 @@ static BOOL do_player_command(struct PlayCDDAData *pcd, pcm_command_t command,
 	if (!send_message_to_pid(pcpd->pcpd_ProcessID, &pcm->pcm_Msg))
 		return FALSE;
 
-	WaitPort(&pcpd->pcpd_ReplyPort);
+	/* Replies to asynchronous commands arrive on the same port. Commands
+	 * that were waiting for them are sent once this one is done. */
+	while (!done) {
+		WaitPort(&pcpd->pcpd_ReplyPort);
+
+		while ((reply = (struct PlayCDDAMsg *)GetMsg(&pcpd->pcpd_ReplyPort)) != NULL) {
+			if (reply == pcm) {
+				done = TRUE;
+				continue;
+			}
 
-	pcm = (struct PlayCDDAMsg *)GetMsg(&pcpd->pcpd_ReplyPort);
+			freed |= (ULONG)1 << reply->pcm_Command;
+			reply->pcm_Command = PCC_INVALID;
+		}
+	}
+
+	/* Nothing to send them to */
+	if (command == PCC_DIE && pcm->pcm_Result)
+		return TRUE;
+
+	for (i = 0; i < PCC_MAX; i++) {
+		pc = &pcpd->pcpd_Pending[i];
+
+		if ((freed & ((ULONG)1 << i)) != 0 && pc->pc_Pending) {
+			pc->pc_Pending = FALSE;
+			send_player_command(pcd, i, pc->pc_Arg1, pc->pc_Arg2);
+		}
+	}
 
 	return pcm->pcm_Result;
 }
@@ -207,130 +240,737 @@ static BOOL do_player_command(struct PlayCDDAData *pcd, pcm_command_t command,
 #define DO_PLAYER_CMD3(pcd, cmd, arg1, arg2, arg3) do_player_command((pcd), (cmd), (arg1), (arg2), (arg3), 0)
 #define DO_PLAYER_CMD4(pcd, cmd, arg1, arg2, arg3, arg4) do_player_command((pcd), (cmd), (arg1), (arg2), (arg3), (arg4))
 
+/* Commands where only the latest one matters */
+static BOOL can_coalesce(pcm_command_t command) {
+	switch (command) {
+		case PCC_SETVOLUME:
+		case PCC_SEEK:
+		case PCC_PREFETCH:
+			return TRUE;
+
+		default:
+			return FALSE;
+	}
+}
+
+/* Sends a command without waiting for the reply. If the same kind of
+ * command is still in flight, the new arguments are kept and sent once
+ * the reply for the old one comes back, so dragging a slider can't queue
+ * up more work than the player gets through. */
+BOOL send_player_command(struct PlayCDDAData *pcd, pcm_command_t command, pcm_arg_t arg1, pcm_arg_t arg2) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	struct PlayCDDAMsg        *pcm  = NULL;
+	int                        i;
+
+	if (pcpd->pcpd_ProcessID == 0)
+		return FALSE;
+
+	/* A seek still waiting to be sent would apply to the new range */
+	if (command == PCC_PLAY || command == PCC_STOP)
+		pcpd->pcpd_Pending[PCC_SEEK].pc_Pending = FALSE;
+
+	for (i = 0; i < PLAYER_CMD_MSGS; i++) {
+		if (can_coalesce(command) && pcpd->pcpd_CmdMsg[i].pcm_Command == command) {
+			pcpd->pcpd_Pending[command].pc_Pending = TRUE;
+			pcpd->pcpd_Pending[command].pc_Arg1    = arg1;
+			pcpd->pcpd_Pending[command].pc_Arg2    = arg2;
+			return TRUE;
+		}
+
+		if (pcm == NULL && pcpd->pcpd_CmdMsg[i].pcm_Command == PCC_INVALID)
+			pcm = &pcpd->pcpd_CmdMsg[i];
+	}
+
+	if (pcm == NULL)
+		return FALSE;
+
+	pcm->pcm_Command = command;
+
+	pcm->pcm_Arg1 = arg1;
+	pcm->pcm_Arg2 = arg2;
+	pcm->pcm_Arg3 = 0;
+	pcm->pcm_Arg4 = 0;
+
+	pcm->pcm_Result = FALSE;
+
+	if (!send_message_to_pid(pcpd->pcpd_ProcessID, &pcm->pcm_Msg)) {
+		pcm->pcm_Command = PCC_INVALID;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Call when get_player_signal() is set */
+void handle_player_replies(struct PlayCDDAData *pcd) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	struct PlayCDDAPendingCmd *pc;
+	struct PlayCDDAMsg        *pcm;
+	pcm_command_t              command;
+
+	if (pcpd->pcpd_ProcessID == 0)
+		return;
+
+	while ((pcm = (struct PlayCDDAMsg *)GetMsg(&pcpd->pcpd_ReplyPort)) != NULL) {
+		command = pcm->pcm_Command;
+		pcm->pcm_Command = PCC_INVALID;
+
+		pc = &pcpd->pcpd_Pending[command];
+		if (pc->pc_Pending) {
+			pc->pc_Pending = FALSE;
+			send_player_command(pcd, command, pc->pc_Arg1, pc->pc_Arg2);
+		}
+	}
+}
+
+ULONG get_player_signal(const struct PlayCDDAData *pcd) {
+	const struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+
+	if (pcpd->pcpd_ProcessID == 0)
+		return 0;
+
+	return (ULONG)1 << pcpd->pcpd_ReplyPort.mp_SigBit;
+}
+
 static void wait_for_death(pcpd_proc_id_t pid) {
 	while (find_proc_by_pid(pid)) Delay(10);
 }
 
+/* Start the reader on a new range. Slots read for the old range are
+ * skipped by the player as it gets to them. */
+static void set_read_range(struct CDDARing *ring, LONG start_addr, LONG end_addr) {
+	ring->cr_StartAddr = start_addr;
+	ring->cr_EndAddr   = end_addr;
+
+	MEMORY_BARRIER();
+	ring->cr_Generation++;
+
+	Signal(ring->cr_ReaderTask, ring->cr_ReaderSig);
+}
+
+/* Hand played slots back to the reader */
+static void release_ring_slots(struct CDDARing *ring, int count) {
+	if (count > 0) {
+		MEMORY_BARRIER();
+		ring->cr_Tail += count;
+
+		Signal(ring->cr_ReaderTask, ring->cr_ReaderSig);
+	}
+}
+
+struct AHIWriteReq {
+	struct AHIRequest *awr_IOReq;
+	WORD              *awr_Buffer;
+	ULONG              awr_EndTime;  /* When the write should have played out */
+	ULONG              awr_DoneTime; /* When it finished playing */
+	BOOL               awr_Done;     /* Finished and waiting to be sent again */
+	int                awr_Release;  /* Ring slots to release when the write finishes */
+	int                awr_Frames;
+};
+
+struct AHIWriteQueue {
+	struct AHIWriteReq wq_Req[MAX_AHI_BUFS];
+	int                wq_NumBufs;
+	int                wq_BufFrames;
+	int                wq_Next;   /* Next request to send */
+	int                wq_Queued;
+	struct AHIRequest *wq_Link;   /* Last request sent, while it's still playing */
+	struct CDDARing   *wq_Ring;
+};
+
+/* 75 sectors per second */
+#define FRAMES_TO_US(frames) ((ULONG)(frames) * 40000 / 3)
+
+/* Split the output latency into as many writes of PCM_BUF_FRAMES as fit,
+ * so that the player can be held up for all but one of them without the
+ * output running dry. */
+static void size_ahi_queue(struct AHIWriteQueue *wq, int latency) {
+	int total, frames, numbufs;
+
+	if (latency < MIN_OUTPUT_LATENCY)
+		latency = MIN_OUTPUT_LATENCY;
+	else if (latency > MAX_OUTPUT_LATENCY)
+		latency = MAX_OUTPUT_LATENCY;
+
+	total = latency * CDDA_FRAMES_PER_SEC / 1000;
+	if (total < 2)
+		total = 2;
+
+	frames = PCM_BUF_FRAMES;
+	if (frames > total / 2)
+		frames = total / 2;
+
+	numbufs = total / frames;
+	if (numbufs > MAX_AHI_BUFS) {
+		numbufs = MAX_AHI_BUFS;
+		frames  = (total + numbufs - 1) / numbufs;
+	}
+
+	wq->wq_NumBufs   = numbufs;
+	wq->wq_BufFrames = frames;
+}
+
+static void send_ahi_write(struct PlayCDDAData *pcd, struct AHIWriteQueue *wq, APTR data, int frames, int release) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	struct AHIWriteReq        *awr  = &wq->wq_Req[wq->wq_Next];
+	struct AHIRequest         *ahir = awr->awr_IOReq;
+	ULONG                      now, start, gap;
+
+	ahir->ahir_Std.io_Command = CMD_WRITE;
+	ahir->ahir_Std.io_Data    = data;
+	ahir->ahir_Std.io_Length  = frames * CDDA_FRAME_SIZE;
+	ahir->ahir_Std.io_Offset  = 0;
+	ahir->ahir_Type           = AHIST_S16S;
+	ahir->ahir_Frequency      = 44100;
+	ahir->ahir_Volume         = pcpd->pcpd_SoftVolume ? 0x10000 : pcpd->pcpd_Volume;
+	ahir->ahir_Position       = 0x10000;
+	ahir->ahir_Link           = wq->wq_Link;
+
+	now = get_time_us(pcd);
+
+	if (awr->awr_Done) {
+		gap = now - awr->awr_DoneTime;
+		if (gap > pcpd->pcpd_Stats.pcps_MaxWriteGap)
+			pcpd->pcpd_Stats.pcps_MaxWriteGap = gap;
+	}
+
+	/* Linked writes play back to back */
+	start = now;
+	if (wq->wq_Queued > 0) {
+		ULONG prev_end = wq->wq_Req[(wq->wq_Next + wq->wq_NumBufs - 1) % wq->wq_NumBufs].awr_EndTime;
+
+		if ((LONG)(prev_end - now) > 0)
+			start = prev_end;
+	}
+
+	awr->awr_EndTime = start + FRAMES_TO_US(frames);
+	awr->awr_Done    = FALSE;
+	awr->awr_Release = release;
+	awr->awr_Frames  = frames;
+
+	SendIO((struct IORequest *)ahir);
+
+	wq->wq_Link = ahir;
+	wq->wq_Next = (wq->wq_Next + 1) % wq->wq_NumBufs;
+	wq->wq_Queued++;
+}
+
+/* Reap finished writes, they complete in the order they were sent */
+static void reap_ahi_writes(struct PlayCDDAData *pcd, struct AHIWriteQueue *wq) {
+	struct AHIWriteReq *awr;
+	ULONG               now;
+
+	now = get_time_us(pcd);
+
+	while (wq->wq_Queued > 0) {
+		awr = &wq->wq_Req[(wq->wq_Next + wq->wq_NumBufs - wq->wq_Queued) % wq->wq_NumBufs];
+
+		if (CheckIO((struct IORequest *)awr->awr_IOReq) == NULL)
+			break;
+
+		WaitIO((struct IORequest *)awr->awr_IOReq);
+
+		if (awr->awr_IOReq == wq->wq_Link)
+			wq->wq_Link = NULL;
+
+		/* If we woke up late, the write finished when it ran out of data
+		 * rather than when we noticed it */
+		awr->awr_DoneTime = now;
+		if ((LONG)(awr->awr_EndTime - now) < 0)
+			awr->awr_DoneTime = awr->awr_EndTime;
+
+		awr->awr_Done = TRUE;
+
+		release_ring_slots(wq->wq_Ring, awr->awr_Release);
+
+		wq->wq_Queued--;
+	}
+}
+
+/* Release a slot in ring order, after any earlier slots that AHI is still
+ * playing from */
+static void release_after_writes(struct AHIWriteQueue *wq, ULONG playpos) {
+	if (wq->wq_Ring->cr_Tail != playpos)
+		wq->wq_Req[(wq->wq_Next + wq->wq_NumBufs - 1) % wq->wq_NumBufs].awr_Release++;
+	else
+		release_ring_slots(wq->wq_Ring, 1);
+}
+
+/* Sectors sent to AHI but not played yet */
+static int queued_frames(const struct AHIWriteQueue *wq) {
+	int i, frames = 0;
+
+	for (i = 1; i <= wq->wq_Queued; i++)
+		frames += wq->wq_Req[(wq->wq_Next + wq->wq_NumBufs - i) % wq->wq_NumBufs].awr_Frames;
+
+	return frames;
+}
+
+/* Idle time that isn't down to the player, e.g. pauses or read underruns,
+ * is not counted as a resubmission delay */
+static void forget_ahi_writes(struct AHIWriteQueue *wq) {
+	int i;
+
+	for (i = 0; i < wq->wq_NumBufs; i++)
+		wq->wq_Req[i].awr_Done = FALSE;
+}
+
+static void flush_ahi_writes(struct AHIWriteQueue *wq) {
+	struct AHIWriteReq *awr;
+
+	while (wq->wq_Queued > 0) {
+		awr = &wq->wq_Req[(wq->wq_Next + wq->wq_NumBufs - wq->wq_Queued) % wq->wq_NumBufs];
+
+		if (CheckIO((struct IORequest *)awr->awr_IOReq) == NULL)
+			AbortIO((struct IORequest *)awr->awr_IOReq);
+
+		WaitIO((struct IORequest *)awr->awr_IOReq);
+
+		release_ring_slots(wq->wq_Ring, awr->awr_Release);
+
+		wq->wq_Queued--;
+	}
+
+	wq->wq_Link = NULL;
+
+	forget_ahi_writes(wq);
+}
+
+/* Track containing addr, starting the search from the last one found */
+static int find_track(const struct PlayCDDATOC *toc, LONG addr, int track) {
+	if (track < 0 || track >= toc->toc_NumTracks || addr < (LONG)toc->toc_Addr[track])
+		track = 0;
+
+	while (track < toc->toc_NumTracks - 1 && addr >= (LONG)toc->toc_Addr[track + 1])
+		track++;
+
+	return track;
+}
+
+/* Cached frames from addr on, timing the unpacking. Stops at end, where
+ * the reader's range starts. The extent may have grown past it since, but
+ * those frames are coming through the ring. */
+static int read_cache(struct PlayCDDAData *pcd, const struct CDDACache *cache, const struct CDDACacheExtent *ext,
+	LONG addr, LONG end, UWORD *buf, UWORD **data)
+{
+	struct PlayCDDAPlayerStats *pcps = &pcd->pcd_PlayerData.pcpd_Stats;
+	ULONG                       start;
+	int                         frames;
+
+	if (!cache->cc_Packed) {
+		frames = read_cdda_cache(cache, ext, addr, buf, data);
+	} else {
+		start  = get_time_us(pcd);
+		frames = read_cdda_cache(cache, ext, addr, buf, data);
+
+		pcps->pcps_UnpackTime += get_time_us(pcd) - start;
+		pcps->pcps_Unpacked   += frames * CDDA_FRAME_SIZE;
+
+		if (pcps->pcps_UnpackTime != 0)
+			pcps->pcps_UnpackRate = ((UQUAD)pcps->pcps_Unpacked * 1000000) / pcps->pcps_UnpackTime;
+	}
+
+	if (frames > end - addr)
+		frames = end - addr;
+
+	return frames;
+}
+
+/* Sequence lock, the GUI retries if it sees an odd or changed count */
+static void publish_status(struct PlayCDDAPlayerData *pcpd, const struct PlayCDDAStatus *status) {
+	pcpd->pcpd_StatusSeq++;
+	MEMORY_BARRIER();
+
+	pcpd->pcpd_Status = *status;
+
+	MEMORY_BARRIER();
+	pcpd->pcpd_StatusSeq++;
+}
+
+void get_player_status(const struct PlayCDDAData *pcd, struct PlayCDDAStatus *status) {
+	const struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	ULONG                            seq;
+
+	do {
+		seq = pcpd->pcpd_StatusSeq;
+		MEMORY_BARRIER();
+
+		*status = pcpd->pcpd_Status;
+
+		MEMORY_BARRIER();
+	} while ((seq & 1) != 0 || seq != pcpd->pcpd_StatusSeq);
+}
+
+/* Converts one write worth of samples, in place on little-endian hosts,
+ * applying the software volume if it's enabled. Returns the gain reached
+ * at the end of the buffer. */
+static LONG convert_samples(struct PlayCDDAData *pcd, const void *src, void *dst, int frames, LONG gain) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	ULONG                      size = frames * CDDA_FRAME_SIZE;
+	LONG                       target, step;
+
+	if (pcpd->pcpd_SoftVolume) {
+		target = pcpd->pcpd_Volume;
+
+		if (gain != 0x10000 || target != 0x10000) {
+			/* Ramp over the whole buffer to avoid zipper noise */
+			step = (target - gain) / (LONG)(size / 4);
+
+			pcd->pcd_ScaleSamples(src, dst, size, gain, step);
+
+			return target;
+		}
+	}
+
+#ifdef WORDS_BIGENDIAN
+	pcd->pcd_SwapSamples(src, dst, size);
+#else
+	if (src != dst)
+		memcpy(dst, src, size);
+#endif
+
+	return 0x10000;
+}
+
 static int player_proc_entry(void) {
-	struct Process            *me;
-	struct MsgPort            *myport;
-	struct PlayCDDAData       *pcd;
-	struct PlayCDDAMsg        *pcm;
-	struct PlayCDDAPlayerData *pcpd;
-	struct MsgPort             ioport;
-	struct IOStdReq           *cdreq = NULL;
-	struct AHIRequest         *ahireq[2]  = { NULL, NULL };
-	struct AHIRequest         *linkreq = NULL;
-	UWORD                     *cddabuf[2] = { NULL, NULL };
-	WORD                      *pcmbuf[2]  = { NULL, NULL };
-	LONG                       read_addr, end_addr;
-	LONG                       play_addr;
-	int                        cddabufid;
-	int                        pcmbufid;
-	int                        cddabufpos;
-	int                        cddaframes;
-	BOOL                       cdisbusy;
-	BOOL                       playing;
-	BOOL                       done;
-	struct SCSICmd             scsicmd;
-	UBYTE                      cmd[12];
-	UBYTE                      sense[128];
-	int                        rc = RETURN_ERROR;
+	struct Process             *me;
+	struct MsgPort             *myport;
+	struct PlayCDDAData        *pcd;
+	struct PlayCDDAMsg         *pcm;
+	struct PlayCDDAPlayerData  *pcpd;
+	struct PlayCDDAPlayerStats *pcps;
+	struct MsgPort              ahiport;
+	struct CDDARing            *ring = NULL;
+	struct CDDARingSlot        *slot;
+	struct AHIWriteQueue        wq;
+	struct AHIWriteReq         *awr;
+	UWORD                      *cddabuf = NULL;
+	ULONG                       playpos = 0;
+	UBYTE                      *data;
+	LONG                        gain = 0x10000;
+	struct PlayCDDAStatus       status;
+	ULONG                       last_signal = 0;
+	int                         track = -1;
+	const struct CDDACacheExtent *ext;
+	ULONG                       cmd_time = 0;
+	BOOL                        seeking = FALSE;
+	BOOL                        starting = FALSE;
+	BOOL                        cached = FALSE;
+#ifndef WORDS_BIGENDIAN
+	BOOL                        mapped;
+#endif
+	UWORD                      *unpackbuf = NULL;
+	LONG                        end_addr = 0;
+	LONG                        play_addr = 0;
+	LONG                        addr;
+	ULONG                       buffered, cachedone, cachesize;
+	ULONG                       sigmask;
+	BYTE                        signal = -1;
+	BOOL                        reader = FALSE;
+	int                         state;
+	int                         cddabufpos;
+	int                         cddaframes;
+	ULONG                       play_start;
+	BOOL                        starved;
+	BOOL                        done;
+	int                         i;
+	int                         rc = RETURN_ERROR;
 
 	me     = (struct Process *)FindTask(NULL);
 	myport = &me->pr_MsgPort;
-	pcd    = me->pr_Task.tc_UserData;
 
 	WaitPort(myport);
 	pcm = (struct PlayCDDAMsg *)GetMsg(myport);
 
-	if (!valid_player_message(pcd, pcm) || pcm->pcm_Command != PCC_STARTUP)
+	if (!is_player_message(pcm) || pcm->pcm_Command != PCC_STARTUP)
 		return RETURN_FAIL;
 
+	pcd = pcm->pcm_GlobalData;
+
 	pcpd = &pcd->pcd_PlayerData;
+	pcps = &pcpd->pcpd_Stats;
 
-	init_msgport(&ioport);
+	memset(&wq, 0, sizeof(wq));
 
-	cdreq = (struct IOStdReq *)copy_iorequest((struct IORequest *)pcd->pcd_CDReq);
-	if (cdreq == NULL)
+	size_ahi_queue(&wq, pcpd->pcpd_OutputLatency);
+
+	init_msgport(&ahiport);
+
+	if ((BYTE)ahiport.mp_SigBit == -1)
 		goto cleanup;
 
-	ahireq[0] = (struct AHIRequest *)copy_iorequest((struct IORequest *)pcd->pcd_AHIReq);
-	ahireq[1] = (struct AHIRequest *)copy_iorequest((struct IORequest *)pcd->pcd_AHIReq);
-	if (ahireq[0] == NULL || ahireq[1] == NULL)
+	signal = AllocSignal(-1);
+	if (signal == -1)
 		goto cleanup;
 
-	cdreq->io_Message.mn_ReplyPort = &ioport;
+	ring = alloc_cdda_ring(pcd);
+	if (ring == NULL)
+		goto cleanup;
 
-	ahireq[0]->ahir_Std.io_Message.mn_ReplyPort = &ioport;
-	ahireq[1]->ahir_Std.io_Message.mn_ReplyPort = &ioport;
+	ring->cr_PlayerTask = &me->pr_Task;
+	ring->cr_PlayerSig  = (ULONG)1 << signal;
 
-	cddabuf[0] = alloc_shared_mem(CDDA_BUF_SIZE);
-	cddabuf[1] = alloc_shared_mem(CDDA_BUF_SIZE);
-	if (cddabuf[0] == NULL || cddabuf[1] == NULL)
-		goto cleanup;
+	wq.wq_Ring = ring;
+
+	for (i = 0; i < wq.wq_NumBufs; i++) {
+		awr = &wq.wq_Req[i];
+
+		awr->awr_IOReq = (struct AHIRequest *)copy_iorequest((struct IORequest *)pcd->pcd_AHIReq);
+		if (awr->awr_IOReq == NULL)
+			goto cleanup;
+
+		awr->awr_IOReq->ahir_Std.io_Message.mn_ReplyPort = &ahiport;
+
+#ifndef WORDS_BIGENDIAN
+		/* Only needed to play from the cache or a mapped disc image */
+		if (ring->cr_Cache == NULL && pcd->pcd_Image == NULL)
+			continue;
+#endif
+
+		awr->awr_Buffer = alloc_shared_mem(wq.wq_BufFrames * CDDA_FRAME_SIZE);
+		if (awr->awr_Buffer == NULL)
+			goto cleanup;
+	}
+
+	memset(pcps, 0, sizeof(*pcps));
+	memset(&status, 0, sizeof(status));
+
+	status.ps_Track = -1;
+	status.ps_Index = 1;
+
+	publish_status(pcpd, &status);
+
+	pcps->pcps_OutputLatency = wq.wq_NumBufs * wq.wq_BufFrames * 1000 / CDDA_FRAMES_PER_SEC;
+
+	if (ring->cr_Cache != NULL && ring->cr_Cache->cc_Packed) {
+		unpackbuf = alloc_shared_mem(CACHE_BLOCK_FRAMES * CDDA_FRAME_SIZE);
+		if (unpackbuf == NULL)
+			goto cleanup;
+	}
 
-	pcmbuf[0] = alloc_shared_mem(PCM_BUF_SIZE);
-	pcmbuf[1] = alloc_shared_mem(PCM_BUF_SIZE);
-	if (pcmbuf[0] == NULL || pcmbuf[1] == NULL)
+	/* The drive is fed from its own process, so that a slow READ CD
+	 * never holds up an AHI write and vice versa */
+	reader = start_reader_proc(pcd, ring);
+	if (!reader)
 		goto cleanup;
 
 	pcm->pcm_Result = TRUE;
 	ReplyMsg(&pcm->pcm_Msg);
+	pcm = NULL;
 
-	playing = FALSE;
-	done    = FALSE;
+	sigmask = ((ULONG)1 << myport->mp_SigBit)
+	        | ((ULONG)1 << ahiport.mp_SigBit)
+	        | ring->cr_PlayerSig;
+
+	state = PS_STOPPED;
+	done  = FALSE;
 
-	cddabufid  = 0;
-	pcmbufid   = 0;
 	cddabufpos = 0;
 	cddaframes = 0;
-	cdisbusy   = FALSE;
+	play_start = 0;
+	starved    = TRUE;
 
+	/* Every pass handles whatever has happened since the last one and then
+	 * sleeps until a command, a finished AHI write or a newly read slot
+	 * arrives. Up to wq_NumBufs writes are linked, so the output keeps
+	 * going for the whole output latency if we don't get to run. */
 	while (!done) {
-		if (!playing) {
-			WaitPort(myport);
-		}
-
 		while ((pcm = (struct PlayCDDAMsg *)GetMsg(myport)) != NULL) {
 			if (valid_player_message(pcd, pcm)) {
 				switch (pcm->pcm_Command) {
 					case PCC_PLAY:
-						if (!playing) {
-							playing = TRUE;
+						if (state == PS_STOPPED) {
+							play_addr = pcm->pcm_Arg1;
+							end_addr  = pcm->pcm_Arg2;
 
-							pcm->pcm_Result = TRUE;
+							ext = NULL;
+							if (ring->cr_Cache != NULL)
+								ext = find_cdda_cache(ring->cr_Cache, play_addr);
+
+							if (ext != NULL) {
+								/* Start from RAM, the reader catches up behind it */
+								set_read_range(ring, cdda_cache_end(ring->cr_Cache, play_addr), end_addr);
+
+								cddaframes = read_cache(pcd, ring->cr_Cache, ext, play_addr, ring->cr_StartAddr,
+									unpackbuf, &cddabuf);
+								cddabufpos = 0;
+								cached     = TRUE;
+
+								pcps->pcps_CacheHits++;
+							} else {
+								set_read_range(ring, play_addr, end_addr);
+
+								cddaframes = 0;
+								cached     = FALSE;
+
+								if (ring->cr_Cache != NULL)
+									pcps->pcps_CacheMisses++;
+							}
+
+							cmd_time = get_time_us(pcd);
+							starting = TRUE;
+
+							gain = pcpd->pcpd_Volume;
+						} else if (state != PS_PAUSED) {
+							pcm->pcm_Result = FALSE;
+							break;
 						}
+
+						state      = PS_PLAYING;
+						starved    = TRUE;
+						play_start = get_time_us(pcd) - pcps->pcps_ReadTime;
+
+						forget_ahi_writes(&wq);
+
+						pcm->pcm_Result = TRUE;
 						break;
 
 					case PCC_PAUSE:
-						if (playing) {
-							playing = FALSE;
+						if (state == PS_PLAYING) {
+							state = PS_PAUSED;
 
 							pcm->pcm_Result = TRUE;
 						}
 						break;
 
 					case PCC_STOP:
-						if (playing) {
-							playing = FALSE;
+						if (state != PS_STOPPED) {
+							state = PS_STOPPED;
 
-							if (cdisbusy) {
-								if (CheckIO((struct IORequest *)cdreq) == NULL)
-									AbortIO((struct IORequest *)cdreq);
+							set_read_range(ring, 0, 0);
+
+							cddaframes = 0;
+							cached     = FALSE;
+
+							/* Nothing is played from the ring any more */
+							flush_ahi_writes(&wq);
+
+							playpos = ring->cr_Head;
+							release_ring_slots(ring, playpos - ring->cr_Tail);
+
+							pcm->pcm_Result = TRUE;
+						}
+						break;
+
+					case PCC_SEEK: {
+						LONG  target = pcm->pcm_Arg1;
+						ULONG pos;
+
+						if (state == PS_STOPPED || target < 0 || target >= end_addr)
+							break;
+
+						cmd_time = get_time_us(pcd);
+						seeking  = (state == PS_PLAYING);
+						starved    = TRUE;
+
+						pcps->pcps_Seeks++;
+
+						/* Whatever AHI has queued is from the old position */
+						flush_ahi_writes(&wq);
+
+						if (cddaframes > 0 && target >= play_addr && target < play_addr + cddaframes) {
+							/* Still in the slot being played from */
+							cddabufpos += target - play_addr;
+							cddaframes -= target - play_addr;
+							play_addr   = target;
+
+							pcps->pcps_SeekHits++;
+							pcm->pcm_Result = TRUE;
+							break;
+						}
 
-								WaitIO((struct IORequest *)cdreq);
-								cdisbusy = FALSE;
+						/* Look for the target further ahead in the ring. Only the
+						 * unplayed slots can be used, as on little-endian hosts
+						 * the played ones may have had the volume applied in
+						 * place already. */
+						pos = playpos;
+						if (cddaframes > 0 && !cached)
+							pos++;
+
+						for (; pos != ring->cr_Head; pos++) {
+							slot = &ring->cr_Slot[pos % ring->cr_NumSlots];
+
+							MEMORY_BARRIER();
+							if (slot->rs_Generation == ring->cr_Generation &&
+								target >= slot->rs_Addr && target < slot->rs_Addr + slot->rs_Frames)
+							{
+								break;
 							}
+						}
+
+						if (pos != ring->cr_Head) {
+							/* Drop everything before it, nothing else needs reading */
+							playpos = pos;
+							release_ring_slots(ring, playpos - ring->cr_Tail);
+
+							cddabuf    = slot->rs_Data;
+							cddabufpos = target - slot->rs_Addr;
+							cddaframes = slot->rs_Frames - cddabufpos;
+							play_addr  = target;
+							cached     = FALSE;
+
+							pcps->pcps_SeekHits++;
+						} else if (ring->cr_Cache != NULL &&
+							(ext = find_cdda_cache(ring->cr_Cache, target)) != NULL)
+						{
+							/* Back to the start of a track, most likely */
+							set_read_range(ring, cdda_cache_end(ring->cr_Cache, target), end_addr);
+
+							cddaframes = read_cache(pcd, ring->cr_Cache, ext, target, ring->cr_StartAddr,
+								unpackbuf, &cddabuf);
+							cddabufpos = 0;
+							play_addr  = target;
+							cached     = TRUE;
+
+							playpos = ring->cr_Head;
+							release_ring_slots(ring, playpos - ring->cr_Tail);
+
+							pcps->pcps_SeekHits++;
+						} else {
+							/* Restart the reader at the target straight away, and
+							 * hand it every slot */
+							set_read_range(ring, target, end_addr);
 
 							cddaframes = 0;
+							play_addr  = target;
+							cached     = FALSE;
 
-							pcm->pcm_Result = TRUE;
+							playpos = ring->cr_Head;
+							release_ring_slots(ring, playpos - ring->cr_Tail);
+						}
+
+						pcm->pcm_Result = TRUE;
+						break;
+					}
+
+					case PCC_PREFETCH:
+						/* Has the reader switch to the file of the new disc */
+						ring->cr_DiscGeneration++;
+
+						if (ring->cr_Cache != NULL) {
+							/* The extents are about to be reused, so give up on the
+							 * one being played (the disc has changed anyway) */
+							if (cached) {
+								cddaframes = 0;
+								cached     = FALSE;
+							}
+
+							ring->cr_Cache->cc_Generation++;
 						}
+
+						Signal(ring->cr_ReaderTask, ring->cr_ReaderSig);
+
+						pcm->pcm_Result = TRUE;
+						break;
+
+					case PCC_SETVOLUME:
+						set_volume(pcd, pcm->pcm_Arg1);
+
+						pcm->pcm_Result = TRUE;
 						break;
 
 					case PCC_DIE:
-						if (playing) {
+						if (state != PS_STOPPED) {
 							pcm->pcm_Result = FALSE;
 							break;
 						}
@@ -347,161 +987,230 @@ static int player_proc_entry(void) {
 			ReplyMsg(&pcm->pcm_Msg);
 		}
 
-		if (playing) {
-			if (cddaframes <= 0) {
-				if (cdisbusy) {
-					WaitIO((struct IORequest *)cdreq);
-					cdisbusy = FALSE;
-					cddabufid ^= 1;
+		reap_ahi_writes(pcd, &wq);
+
+		while (state == PS_PLAYING && wq.wq_Queued < wq.wq_NumBufs) {
+			int frames;
+
+			if (cddaframes <= 0 && cached) {
+				LONG next = play_addr;
+
+				/* Stay in RAM up to where the reader started, into the next
+				 * track if it's cached as well */
+				ext = next_cdda_cache(ring->cr_Cache, &next);
+				if (ext != NULL && next < end_addr && next < ring->cr_StartAddr) {
+					cddaframes = read_cache(pcd, ring->cr_Cache, ext, next, ring->cr_StartAddr,
+						unpackbuf, &cddabuf);
+					cddabufpos = 0;
+					play_addr  = next;
 				} else {
-					int frames;
-
-					frames = CDDA_BUF_FRAMES;
-					if (frames > (end_addr - read_addr))
-						frames = end_addr - read_addr;
-
-					/* READ CD command */
-					cmd[ 0] = 0xBE;
-					cmd[ 1] = 0x04;
-					cmd[ 2] = ((ULONG)read_addr >> 24) & 0xFF;
-					cmd[ 3] = ((ULONG)read_addr >> 16) & 0xFF;
-					cmd[ 4] = ((ULONG)read_addr >> 8) & 0xFF;
-					cmd[ 5] = (ULONG)read_addr & 0xFF;
-					cmd[ 6] = 0;
-					cmd[ 7] = 0;
-					cmd[ 8] = frames;
-					cmd[ 9] = 0x10;
-					cmd[10] = 0;
-					cmd[11] = 0;
-
-					scsicmd.scsi_Data        = cddabuf[cddabufid];
-					scsicmd.scsi_Length      = frames * CDDA_FRAME_SIZE;
-					scsicmd.scsi_Actual      = 0;
-					scsicmd.scsi_Command     = cmd;
-					scsicmd.scsi_CmdLength   = 12;
-					scsicmd.scsi_CmdActual   = 0;
-					scsicmd.scsi_Flags       = SCSIF_READ | SCSIF_AUTOSENSE;
-					scsicmd.scsi_Status      = 0;
-					scsicmd.scsi_SenseData   = sense;
-					scsicmd.scsi_SenseLength = sizeof(sense);
-					scsicmd.scsi_SenseActual = 0;
-
-					cdreq->io_Command = HD_SCSICMD;
-					cdreq->io_Data    = &scsicmd;
-					cdreq->io_Length  = sizeof(scsicmd);
-
-					DoIO((struct IORequest *)cdreq);
+					cached = FALSE;
 				}
+			}
 
-				if (cdreq->io_Error == 0) {
-					int frames;
+			if (cddaframes <= 0) {
+				/* Skip slots that were read for an earlier range */
+				while (playpos != ring->cr_Head) {
+					slot = &ring->cr_Slot[playpos % ring->cr_NumSlots];
 
-					cddabufpos = 0;
-					cddaframes = cmd[8];
-					read_addr += cddaframes;
-
-					frames = CDDA_BUF_FRAMES;
-					if (frames > (end_addr - read_addr))
-						frames = end_addr - read_addr;
-
-					/* READ CD command */
-					cmd[ 0] = 0xBE;
-					cmd[ 1] = 0x04;
-					cmd[ 2] = ((ULONG)read_addr >> 24) & 0xFF;
-					cmd[ 3] = ((ULONG)read_addr >> 16) & 0xFF;
-					cmd[ 4] = ((ULONG)read_addr >> 8) & 0xFF;
-					cmd[ 5] = (ULONG)read_addr & 0xFF;
-					cmd[ 6] = 0;
-					cmd[ 7] = 0;
-					cmd[ 8] = frames;
-					cmd[ 9] = 0x10;
-					cmd[10] = 0;
-					cmd[11] = 0;
-
-					scsicmd.scsi_Data        = cddabuf[cddabufid ^ 1];
-					scsicmd.scsi_Length      = frames * CDDA_FRAME_SIZE;
-					scsicmd.scsi_Actual      = 0;
-					scsicmd.scsi_Command     = cmd;
-					scsicmd.scsi_CmdLength   = 12;
-					scsicmd.scsi_CmdActual   = 0;
-					scsicmd.scsi_Flags       = SCSIF_READ | SCSIF_AUTOSENSE;
-					scsicmd.scsi_Status      = 0;
-					scsicmd.scsi_SenseData   = sense;
-					scsicmd.scsi_SenseLength = sizeof(sense);
-					scsicmd.scsi_SenseActual = 0;
-
-					cdreq->io_Command = HD_SCSICMD;
-					cdreq->io_Data    = &scsicmd;
-					cdreq->io_Length  = sizeof(scsicmd);
-
-					SendIO((struct IORequest *)cdreq);
-
-					cdisbusy = TRUE;
+					MEMORY_BARRIER();
+					if (slot->rs_Generation == ring->cr_Generation)
+						break;
+
+					release_after_writes(&wq, playpos++);
+				}
+
+				if (playpos == ring->cr_Head) {
+					if (ring->cr_Failed == ring->cr_Generation) {
+						/* The reader gave up */
+						state = PS_STOPPED;
+					} else if (wq.wq_Queued == 0 && !starved) {
+						/* Count it only if the output actually ran dry */
+						pcps->pcps_Underruns++;
+						starved = TRUE;
+
+						forget_ahi_writes(&wq);
+					}
+					break;
+				}
+
+				cddabuf    = slot->rs_Data;
+				cddabufpos = 0;
+				cddaframes = slot->rs_Frames;
+				play_addr  = slot->rs_Addr;
+
+				pcps->pcps_ReadTime = get_time_us(pcd) - play_start;
+				if (pcps->pcps_ReadTime != 0) {
+					pcps->pcps_ReadRate = ((UQUAD)pcps->pcps_FramesRead * CDDA_FRAME_SIZE * 1000000)
+						/ pcps->pcps_ReadTime;
 				}
 			}
 
-			if (cddaframes > 0) {
-				int frames;
+			frames = wq.wq_BufFrames;
+			if (frames > cddaframes)
+				frames = cddaframes;
 
-				frames = PCM_BUF_FRAMES;
-				if (frames > cddaframes)
-					frames = cddaframes;
+			data = (UBYTE *)cddabuf + (cddabufpos * CDDA_FRAME_SIZE);
 
-				swab((UBYTE *)cddabuf[cddabufid] + (cddabufpos * CDDA_FRAME_SIZE),
-					pcmbuf[pcmbufid], frames * CDDA_FRAME_SIZE);
+#ifdef WORDS_BIGENDIAN
+			gain = convert_samples(pcd, data, wq.wq_Req[wq.wq_Next].awr_Buffer, frames, gain);
 
-				ahireq[pcmbufid]->ahir_Std.io_Command = CMD_WRITE;
-				ahireq[pcmbufid]->ahir_Std.io_Data    = pcmbuf[pcmbufid];
-				ahireq[pcmbufid]->ahir_Std.io_Length  = frames * CDDA_FRAME_SIZE;
-				ahireq[pcmbufid]->ahir_Std.io_Offset  = 0;
-				ahireq[pcmbufid]->ahir_Type           = AHIST_S16S;
-				ahireq[pcmbufid]->ahir_Frequency      = 44100;
-				ahireq[pcmbufid]->ahir_Volume         = pcpd->pcpd_Volume;
-				ahireq[pcmbufid]->ahir_Position       = 0x10000;
-				ahireq[pcmbufid]->ahir_Link           = linkreq;
+			send_ahi_write(pcd, &wq, wq.wq_Req[wq.wq_Next].awr_Buffer, frames, 0);
 
-				SendIO((struct IORequest *)ahireq[pcmbufid]);
+			if (frames == cddaframes && !cached) {
+				/* Slot fully copied, hand it back to the reader */
+				release_after_writes(&wq, playpos);
+				playpos++;
+			}
+#else
+			/* CDDA is already in the native byte order, so AHI plays straight
+			 * from the ring. The slot is released by the write that finishes
+			 * it. A slot can also point into a mapped disc image, which is
+			 * played straight from the mapping unless the volume has to be
+			 * applied. */
+			mapped = !cached && cddabuf != ring->cr_Slot[playpos % ring->cr_NumSlots].rs_Buffer;
 
-				if (linkreq)
-					WaitIO((struct IORequest *)linkreq);
+			if (cached || (mapped && pcpd->pcpd_SoftVolume)) {
+				/* The cache and the image have to stay as they are */
+				awr = &wq.wq_Req[wq.wq_Next];
 
-				linkreq = ahireq[pcmbufid];
-				pcmbufid ^= 1;
+				gain = convert_samples(pcd, data, awr->awr_Buffer, frames, gain);
 
-				play_addr  += frames;
-				cddabufpos += frames;
-				cddaframes -= frames;
+				send_ahi_write(pcd, &wq, awr->awr_Buffer, frames, 0);
 
-				if (play_addr >= end_addr)
-					playing = FALSE;
+				if (frames == cddaframes && !cached) {
+					release_after_writes(&wq, playpos);
+					playpos++;
+				}
 			} else {
-				playing = FALSE;
+				gain = convert_samples(pcd, data, data, frames, gain);
+
+				send_ahi_write(pcd, &wq, data, frames, frames == cddaframes);
+
+				if (frames == cddaframes)
+					playpos++;
+			}
+#endif
+
+			starved = FALSE;
+
+			if (starting) {
+				pcps->pcps_StartLatency = get_time_us(pcd) - cmd_time;
+				starting = FALSE;
+			}
+
+			if (seeking) {
+				pcps->pcps_SeekLatency = get_time_us(pcd) - cmd_time;
+				if (pcps->pcps_SeekLatency > pcps->pcps_MaxSeekLatency)
+					pcps->pcps_MaxSeekLatency = pcps->pcps_SeekLatency;
+				seeking = FALSE;
 			}
 
-			/* FIXME: Signal main process, so that the GUI can be updated */
+			play_addr  += frames;
+			cddabufpos += frames;
+			cddaframes -= frames;
+
+			if (play_addr >= end_addr)
+				state = PS_STOPPED;
+
 		}
+
+		if (state == PS_STOPPED && ring->cr_EndAddr != 0) {
+			set_read_range(ring, 0, 0);
+			cddaframes = 0;
+			cached     = FALSE;
+		}
+
+		/* Let the GUI know, but no more often than pcpd_StatusInterval
+		 * unless the state changed */
+		addr      = status.ps_Addr;
+		buffered  = 0;
+		cachedone = 0;
+		cachesize = 0;
+
+		if (state != PS_STOPPED) {
+			addr     = play_addr - queued_frames(&wq);
+			buffered = cdda_ring_fill(ring, playpos);
+
+			if (cached)
+				buffered += cddaframes;
+			else if (cddaframes > 0)
+				buffered -= cddabufpos;
+
+			track = find_track(&pcd->pcd_TOC, addr, track);
+		} else {
+			track = -1;
+		}
+
+		if (ring->cr_Cache != NULL) {
+			cachedone = ring->cr_Cache->cc_FramesDone;
+			cachesize = ring->cr_Cache->cc_FramesTotal;
+		}
+
+		if (state != status.ps_State || addr != status.ps_Addr || buffered != status.ps_Buffered ||
+			cachedone != status.ps_Cached || cachesize != status.ps_CacheSize)
+		{
+			ULONG now = get_time_us(pcd);
+			BOOL  changed = (state != status.ps_State);
+
+			status.ps_State     = state;
+			status.ps_Addr      = addr;
+			status.ps_Track     = track;
+			status.ps_Buffered  = buffered;
+			status.ps_Cached    = cachedone;
+			status.ps_CacheSize = cachesize;
+
+			publish_status(pcpd, &status);
+
+			if (changed || (now - last_signal) >= pcpd->pcpd_StatusInterval) {
+				Signal(&pcd->pcd_MainProc->pr_Task, (ULONG)1 << pcd->pcd_StatusSignal);
+				last_signal = now;
+			}
+		}
+
+		if (!done)
+			Wait(sigmask);
 	}
 
+	rc = RETURN_OK;
+
 cleanup:
-	free_shared_mem(pcmbuf[0], PCM_BUF_SIZE);
-	free_shared_mem(pcmbuf[1], PCM_BUF_SIZE);
+	if (pcm != NULL) {
+		/* Startup failed */
+		pcm->pcm_Result = FALSE;
+		ReplyMsg(&pcm->pcm_Msg);
+	}
 
-	free_shared_mem(cddabuf[0], CDDA_BUF_SIZE);
-	free_shared_mem(cddabuf[1], CDDA_BUF_SIZE);
+	flush_ahi_writes(&wq);
 
-	delete_iorequest_copy((struct IORequest *)ahireq[0]);
-	delete_iorequest_copy((struct IORequest *)ahireq[1]);
+	if (reader)
+		stop_reader_proc(ring);
 
-	delete_iorequest_copy((struct IORequest *)cdreq);
+	for (i = 0; i < wq.wq_NumBufs; i++) {
+		awr = &wq.wq_Req[i];
 
-	deinit_msgport(&ioport);
+		if (awr->awr_Buffer != NULL)
+			free_shared_mem(awr->awr_Buffer, wq.wq_BufFrames * CDDA_FRAME_SIZE);
+
+		delete_iorequest_copy((struct IORequest *)awr->awr_IOReq);
+	}
+
+	if (unpackbuf != NULL)
+		free_shared_mem(unpackbuf, CACHE_BLOCK_FRAMES * CDDA_FRAME_SIZE);
+
+	free_cdda_ring(ring);
+
+	FreeSignal(signal);
+
+	deinit_msgport(&ahiport);
 
 	return rc;
 }
 
-static BOOL UNUSED start_player_proc(struct PlayCDDAData *pcd) {
+BOOL start_player_proc(struct PlayCDDAData *pcd) {
 	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
 	struct Process            *proc;
+	int                        i;
 
 	if (pcpd->pcpd_ProcessID != 0)
 		return TRUE;
@@ -510,6 +1219,11 @@ static BOOL UNUSED start_player_proc(struct PlayCDDAData *pcd) {
 
 	init_player_message(pcd, &pcpd->pcpd_PlayerMsg, &pcpd->pcpd_ReplyPort);
 
+	for (i = 0; i < PLAYER_CMD_MSGS; i++)
+		init_player_message(pcd, &pcpd->pcpd_CmdMsg[i], &pcpd->pcpd_ReplyPort);
+
+	memset(pcpd->pcpd_Pending, 0, sizeof(pcpd->pcpd_Pending));
+
 	proc = CreateNewProcTags(
 		NP_Name,        "PlayCDDA Audio Process",
 		NP_Entry,       &player_proc_entry,
@@ -552,12 +1266,15 @@ cleanup:
 	return FALSE;
 }
 
-static void UNUSED kill_player_proc(struct PlayCDDAData *pcd) {
+void kill_player_proc(struct PlayCDDAData *pcd) {
 	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
 
 	if (pcpd->pcpd_ProcessID == 0)
 		return;
 
+	/* The player only accepts PCC_DIE when stopped */
+	DO_PLAYER_CMD0(pcd, PCC_STOP);
+
 	if (!DO_PLAYER_CMD0(pcd, PCC_DIE))
 		return;
 
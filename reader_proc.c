@@ -0,0 +1,1074 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+#include <devices/scsidisk.h>
+
+struct CDDAReadReq {
+	struct IOStdReq *crr_IOReq;
+	UWORD           *crr_Buffer;
+	UWORD           *crr_Data;    /* crr_Buffer, or into a mapped disc image */
+	LONG             crr_Addr;
+	int              crr_Frames;
+	BOOL             crr_Busy;
+	BOOL             crr_Timed;
+	BOOL             crr_Local;   /* Read from the disc image or the sector cache file, never sent */
+	ULONG            crr_Disc;    /* cr_DiscGeneration when it was sent */
+	ULONG            crr_SendTime;
+	struct SCSICmd   crr_SCSICmd;
+	UBYTE            crr_Cmd[12];
+	UBYTE            crr_Sense[128];
+};
+
+/* Transfer size controller */
+struct CDDAReadCtl {
+	int   rc_Frames;     /* Sectors per READ CD */
+	int   rc_MinFrames;
+	int   rc_MaxFrames;  /* Limited by the buffer size */
+	int   rc_Step;       /* Direction of the last change, 0 when settled */
+	int   rc_Samples;    /* Commands measured at the current size */
+	int   rc_Holds;      /* Measurement windows spent settled */
+	ULONG rc_Latency;    /* Smoothed per command latency in microseconds */
+	ULONG rc_Rate;       /* Smoothed bytes per second at the current size */
+	ULONG rc_PrevRate;   /* Rate before the last change */
+};
+
+struct CDDAReadQueue {
+	struct CDDAReadReq rq_Req[MAX_CDDA_BUFS];
+	int                rq_NumBufs;
+	int                rq_BufFrames;
+	int                rq_Head;     /* Ring slot of the oldest read in flight */
+	int                rq_Queued;   /* Reads in flight, not yet published */
+	int                rq_Errors;   /* Consecutive failed reads */
+	ULONG              rq_LastDone;
+	struct CDDAReadCtl rq_Ctl;
+};
+
+#define READCTL_SAMPLES     4      /* Commands per measurement window */
+#define READCTL_HOLD        16     /* Windows to stay settled before probing again */
+#define READCTL_MAX_LATENCY 500000 /* Upper limit for a single command (us) */
+
+#define MAX_READ_ERRORS     8
+
+static void set_read_frames(struct CDDAReadCtl *rc, int frames, int step) {
+	if (frames < rc->rc_MinFrames)
+		frames = rc->rc_MinFrames;
+	else if (frames > rc->rc_MaxFrames)
+		frames = rc->rc_MaxFrames;
+
+	if (frames == rc->rc_Frames)
+		step = 0;
+
+	rc->rc_Frames   = frames;
+	rc->rc_Step     = step;
+	rc->rc_Samples  = 0;
+	rc->rc_Holds    = 0;
+	rc->rc_PrevRate = rc->rc_Rate;
+}
+
+static void update_read_ctl(struct CDDAReadCtl *rc, int frames, ULONG latency, BOOL error) {
+	ULONG rate;
+
+	if (error) {
+		/* Some drives can't handle large transfers, back off quickly */
+		set_read_frames(rc, rc->rc_Frames / 2, 0);
+		return;
+	}
+
+	if (latency == 0)
+		latency = 1;
+
+	rate = ((UQUAD)frames * CDDA_FRAME_SIZE * 1000000) / latency;
+
+	if (rc->rc_Samples == 0) {
+		rc->rc_Latency = latency;
+		rc->rc_Rate    = rate;
+	} else {
+		rc->rc_Latency = (rc->rc_Latency * 3 + latency) / 4;
+		rc->rc_Rate    = ((UQUAD)rc->rc_Rate * 3 + rate) / 4;
+	}
+
+	if (++rc->rc_Samples < READCTL_SAMPLES)
+		return;
+
+	rc->rc_Samples = 0;
+
+	if (rc->rc_Latency > READCTL_MAX_LATENCY) {
+		/* Commands take too long, shrink and settle there */
+		set_read_frames(rc, rc->rc_Frames * 4 / 5, 0);
+	} else if (rc->rc_Step == 0) {
+		/* Settled, probe for a larger size now and then */
+		if (++rc->rc_Holds >= READCTL_HOLD)
+			set_read_frames(rc, rc->rc_Frames + (rc->rc_Frames + 3) / 4, 1);
+	} else if (rc->rc_Rate > rc->rc_PrevRate + rc->rc_PrevRate / 16) {
+		/* Growing paid off, keep going */
+		set_read_frames(rc, rc->rc_Frames + (rc->rc_Frames + 3) / 4, 1);
+	} else {
+		/* No gain, undo the last step and settle */
+		set_read_frames(rc, rc->rc_Frames * 4 / 5, 0);
+	}
+}
+
+static void send_read_cd(struct PlayCDDAData *pcd, struct CDDAReadReq *crr, LONG addr, int frames) {
+	struct IOStdReq *cdreq   = crr->crr_IOReq;
+	struct SCSICmd  *scsicmd = &crr->crr_SCSICmd;
+	UBYTE           *cmd     = crr->crr_Cmd;
+
+	/* READ CD command */
+	cmd[ 0] = 0xBE;
+	cmd[ 1] = 0x04;
+	cmd[ 2] = ((ULONG)addr >> 24) & 0xFF;
+	cmd[ 3] = ((ULONG)addr >> 16) & 0xFF;
+	cmd[ 4] = ((ULONG)addr >> 8) & 0xFF;
+	cmd[ 5] = (ULONG)addr & 0xFF;
+	cmd[ 6] = ((ULONG)frames >> 16) & 0xFF;
+	cmd[ 7] = ((ULONG)frames >> 8) & 0xFF;
+	cmd[ 8] = (ULONG)frames & 0xFF;
+	cmd[ 9] = 0x10;
+	cmd[10] = 0;
+	cmd[11] = 0;
+
+	scsicmd->scsi_Data        = crr->crr_Buffer;
+	scsicmd->scsi_Length      = frames * CDDA_FRAME_SIZE;
+	scsicmd->scsi_Actual      = 0;
+	scsicmd->scsi_Command     = cmd;
+	scsicmd->scsi_CmdLength   = 12;
+	scsicmd->scsi_CmdActual   = 0;
+	scsicmd->scsi_Flags       = SCSIF_READ | SCSIF_AUTOSENSE;
+	scsicmd->scsi_Status      = 0;
+	scsicmd->scsi_SenseData   = crr->crr_Sense;
+	scsicmd->scsi_SenseLength = sizeof(crr->crr_Sense);
+	scsicmd->scsi_SenseActual = 0;
+
+	cdreq->io_Command = HD_SCSICMD;
+	cdreq->io_Data    = scsicmd;
+	cdreq->io_Length  = sizeof(*scsicmd);
+
+	crr->crr_Data     = crr->crr_Buffer;
+	crr->crr_Addr     = addr;
+	crr->crr_Frames   = frames;
+	crr->crr_Busy     = TRUE;
+	crr->crr_Timed    = FALSE;
+	crr->crr_Local    = FALSE;
+	crr->crr_SendTime = get_time_us(pcd);
+
+	SendIO((struct IORequest *)cdreq);
+}
+
+/* Serves a read from the disc image, or from the sector cache file if the
+ * sectors at addr are in there. The request is completed without being
+ * sent, and is handled the same as one that was. With map set, a mapped
+ * image is handed out in place instead of being copied into crr_Buffer.
+ * Returns 0 if the drive has to be used. */
+static int read_local(struct PlayCDDAData *pcd, struct DiskCache *dc, struct CDDAReadReq *crr, LONG addr, int frames,
+	BOOL map)
+{
+	struct PlayCDDAPlayerStats *pcps = &pcd->pcd_PlayerData.pcpd_Stats;
+	ULONG                       start;
+	UWORD                      *data = NULL;
+	int                         count;
+
+	crr->crr_Data = crr->crr_Buffer;
+
+	if (pcd->pcd_Image != NULL) {
+		start = get_time_us(pcd);
+
+		if (map)
+			data = map_cd_image(pcd->pcd_Image, addr, frames, &count);
+
+		if (data != NULL) {
+			crr->crr_Data = data;
+			crr->crr_IOReq->io_Error = 0;
+			frames = count;
+
+			pcps->pcps_ImageMapped += frames * CDDA_FRAME_SIZE;
+		} else {
+			crr->crr_IOReq->io_Error = read_cd_image(pcd->pcd_Image, addr, frames, crr->crr_Buffer) ? 0 : HFERR_BadStatus;
+
+			pcps->pcps_ImageCopied += frames * CDDA_FRAME_SIZE;
+		}
+
+		pcps->pcps_ImageTime += get_time_us(pcd) - start;
+	} else {
+		frames = read_disk_cache(dc, addr, frames, crr->crr_Buffer);
+		if (frames == 0)
+			return 0;
+
+		crr->crr_IOReq->io_Error = 0;
+	}
+
+	crr->crr_Addr   = addr;
+	crr->crr_Frames = frames;
+	crr->crr_Busy   = FALSE;
+	crr->crr_Timed  = TRUE;
+	crr->crr_Local  = TRUE;
+
+	return frames;
+}
+
+static void abort_read_cd(struct CDDAReadReq *crr) {
+	if (crr->crr_Busy) {
+		if (CheckIO((struct IORequest *)crr->crr_IOReq) == NULL)
+			AbortIO((struct IORequest *)crr->crr_IOReq);
+
+		WaitIO((struct IORequest *)crr->crr_IOReq);
+		crr->crr_Busy  = FALSE;
+		crr->crr_Timed = TRUE;
+	}
+}
+
+static void flush_read_queue(struct CDDAReadQueue *rq, int keep) {
+	int i;
+
+	for (i = keep; i < rq->rq_Queued; i++)
+		abort_read_cd(&rq->rq_Req[(rq->rq_Head + i) % rq->rq_NumBufs]);
+
+	rq->rq_Queued = keep;
+}
+
+static void complete_read(struct PlayCDDAData *pcd, struct CDDAReadQueue *rq, struct CDDAReadReq *crr, ULONG now) {
+	ULONG start = crr->crr_SendTime;
+
+	/* The drive serves the queued commands one at a time, so a command
+	 * doesn't start until the previous one has finished */
+	if ((LONG)(rq->rq_LastDone - start) > 0)
+		start = rq->rq_LastDone;
+
+	rq->rq_LastDone = now;
+	crr->crr_Timed  = TRUE;
+
+	update_read_ctl(&rq->rq_Ctl, crr->crr_Frames, now - start, crr->crr_IOReq->io_Error != 0);
+}
+
+static void poll_read_queue(struct PlayCDDAData *pcd, struct CDDAReadQueue *rq) {
+	struct CDDAReadReq *crr;
+	ULONG               now;
+	int                 i;
+
+	now = get_time_us(pcd);
+
+	for (i = 0; i < rq->rq_Queued; i++) {
+		crr = &rq->rq_Req[(rq->rq_Head + i) % rq->rq_NumBufs];
+
+		if (crr->crr_Timed)
+			continue;
+
+		if (CheckIO((struct IORequest *)crr->crr_IOReq) == NULL)
+			break;
+
+		complete_read(pcd, rq, crr, now);
+	}
+}
+
+struct SpeedGovernor {
+	struct IOStdReq *sg_IOReq;
+	BOOL             sg_Busy;
+	BOOL             sg_Disabled;  /* Drive doesn't support SET CD SPEED */
+	int              sg_Speed;     /* Multiple of 1x, 0 = drive maximum, SPEED_UNSET before the first */
+	int              sg_HighCount; /* Evaluations spent above the high watermark */
+	struct SCSICmd   sg_SCSICmd;
+	UBYTE            sg_Cmd[12];
+	UBYTE            sg_Sense[32];
+};
+
+#define SPEED_UNSET       -1
+#define SPEED_MIN         2
+#define SPEED_START       4
+#define SPEED_LIMIT       48 /* Top of the table, drive maximum (0) is above it */
+#define GOV_LOW_WATERMARK  40 /* Percentage of the read buffers */
+#define GOV_HIGH_WATERMARK 80
+#define GOV_DOWN_DELAY     8  /* Evaluations above the high watermark before slowing down */
+
+/* 1x is 176.4 kB/s, 0xFFFF selects the maximum speed of the drive */
+#define SPEED_TO_KBPS(speed) (((speed) > 0) ? ((speed) * 1764 + 5) / 10 : 0xFFFF)
+
+static void send_set_cd_speed(struct SpeedGovernor *sg, int speed, BOOL sync) {
+	struct IOStdReq *ioreq   = sg->sg_IOReq;
+	struct SCSICmd  *scsicmd = &sg->sg_SCSICmd;
+	UBYTE           *cmd     = sg->sg_Cmd;
+	ULONG            kbps    = SPEED_TO_KBPS(speed);
+
+	/* SET CD SPEED command */
+	cmd[ 0] = 0xBB;
+	cmd[ 1] = 0;
+	cmd[ 2] = (kbps >> 8) & 0xFF;
+	cmd[ 3] = kbps & 0xFF;
+	cmd[ 4] = 0xFF;
+	cmd[ 5] = 0xFF;
+	cmd[ 6] = 0;
+	cmd[ 7] = 0;
+	cmd[ 8] = 0;
+	cmd[ 9] = 0;
+	cmd[10] = 0;
+	cmd[11] = 0;
+
+	memset(scsicmd, 0, sizeof(*scsicmd));
+
+	scsicmd->scsi_Command     = cmd;
+	scsicmd->scsi_CmdLength   = 12;
+	scsicmd->scsi_Flags       = SCSIF_AUTOSENSE;
+	scsicmd->scsi_SenseData   = sg->sg_Sense;
+	scsicmd->scsi_SenseLength = sizeof(sg->sg_Sense);
+
+	ioreq->io_Command = HD_SCSICMD;
+	ioreq->io_Data    = scsicmd;
+	ioreq->io_Length  = sizeof(*scsicmd);
+
+	sg->sg_Speed = speed;
+
+	if (sync) {
+		DoIO((struct IORequest *)ioreq);
+	} else {
+		SendIO((struct IORequest *)ioreq);
+		sg->sg_Busy = TRUE;
+	}
+}
+
+static void finish_set_cd_speed(struct SpeedGovernor *sg) {
+	if (sg->sg_Busy) {
+		WaitIO((struct IORequest *)sg->sg_IOReq);
+		sg->sg_Busy = FALSE;
+
+		if (sg->sg_IOReq->io_Error != 0)
+			sg->sg_Disabled = TRUE;
+	}
+}
+
+/* Hold the drive at the lowest speed that keeps the read buffers filled
+ * above the low watermark, instead of letting it spin up to maximum speed
+ * and down again for every refill. */
+static void update_speed_governor(struct SpeedGovernor *sg, int mode, int fill, int capacity) {
+	int speed;
+
+	if (sg->sg_Busy) {
+		if (CheckIO((struct IORequest *)sg->sg_IOReq) == NULL)
+			return;
+
+		finish_set_cd_speed(sg);
+	}
+
+	if (sg->sg_Disabled)
+		return;
+
+	if (mode == SPEED_MAX) {
+		if (sg->sg_Speed != 0)
+			send_set_cd_speed(sg, 0, FALSE);
+		return;
+	}
+
+	/* Maximum speed, from the whole-disc prefetch or the governor
+	 * itself, sorts above SPEED_LIMIT: there's nothing to step up to, and
+	 * stepping down goes to SPEED_LIMIT */
+	speed = sg->sg_Speed;
+	if (speed == SPEED_UNSET)
+		speed = SPEED_START;
+
+	if (fill * 100 < capacity * GOV_LOW_WATERMARK) {
+		sg->sg_HighCount = 0;
+
+		if (speed != 0) {
+			speed *= 2;
+			if (speed > SPEED_LIMIT)
+				speed = 0;
+		}
+	} else if (fill * 100 > capacity * GOV_HIGH_WATERMARK) {
+		if (++sg->sg_HighCount >= GOV_DOWN_DELAY) {
+			sg->sg_HighCount = 0;
+
+			if (speed == 0)
+				speed = SPEED_LIMIT;
+			else if (speed > SPEED_MIN)
+				speed--;
+		}
+	} else {
+		sg->sg_HighCount = 0;
+	}
+
+	if (speed != sg->sg_Speed)
+		send_set_cd_speed(sg, speed, FALSE);
+}
+
+struct Prefetcher {
+	struct CDDAReadReq pf_Req;
+	UWORD             *pf_Buffer;     /* To pack from */
+	int                pf_BufFrames;
+	ULONG              pf_Generation; /* Cache layout being filled */
+	int                pf_Pass;       /* Start of every track first, then the rest */
+	int                pf_Extent;     /* Extent being filled */
+	BOOL               pf_Stopped;    /* Drive spun down after caching the disc */
+};
+
+/* START STOP UNIT, returns at once and lets the drive spin down */
+static void stop_unit(struct CDDAReadReq *crr) {
+	struct IOStdReq *cdreq   = crr->crr_IOReq;
+	struct SCSICmd  *scsicmd = &crr->crr_SCSICmd;
+	UBYTE           *cmd     = crr->crr_Cmd;
+
+	cmd[0] = 0x1B;
+	cmd[1] = 0x01;
+	cmd[2] = 0;
+	cmd[3] = 0;
+	cmd[4] = 0;
+	cmd[5] = 0;
+
+	memset(scsicmd, 0, sizeof(*scsicmd));
+
+	scsicmd->scsi_Command     = cmd;
+	scsicmd->scsi_CmdLength   = 6;
+	scsicmd->scsi_Flags       = SCSIF_AUTOSENSE;
+	scsicmd->scsi_SenseData   = crr->crr_Sense;
+	scsicmd->scsi_SenseLength = sizeof(crr->crr_Sense);
+
+	cdreq->io_Command = HD_SCSICMD;
+	cdreq->io_Data    = scsicmd;
+	cdreq->io_Length  = sizeof(*scsicmd);
+
+	DoIO((struct IORequest *)cdreq);
+}
+
+/* Next extent to fill, and how many frames it still needs in this pass */
+static struct CDDACacheExtent *next_prefetch(struct CDDACache *cache, struct Prefetcher *pf, int *frames) {
+	struct CDDACacheExtent *ext;
+	int                     target;
+
+	for (; pf->pf_Pass < 2; pf->pf_Pass++, pf->pf_Extent = 0) {
+		for (; pf->pf_Extent < cache->cc_NumExtents; pf->pf_Extent++) {
+			ext = &cache->cc_Extent[pf->pf_Extent];
+
+			target = ext->ce_Frames;
+			if (pf->pf_Pass == 0 && target > cache->cc_IntroFrames)
+				target = cache->cc_IntroFrames;
+
+			if (ext->ce_Done < target) {
+				*frames = target - ext->ce_Done;
+				return ext;
+			}
+		}
+	}
+
+	return NULL;
+}
+
+/* Fill the cache one READ CD at a time, while there's no range to read.
+ * Returns TRUE if a part was taken from the sector cache file, and the
+ * next one can be filled right away. */
+static BOOL update_prefetch(struct PlayCDDAData *pcd, struct CDDARing *ring, struct Prefetcher *pf,
+	struct DiskCache *dc, BOOL idle, int maxframes)
+{
+	struct PlayCDDAPlayerStats *pcps = &pcd->pcd_PlayerData.pcpd_Stats;
+	struct CDDACache           *cache = ring->cr_Cache;
+	struct CDDAReadReq         *crr = &pf->pf_Req;
+	struct CDDACacheExtent     *ext;
+	LONG                        addr;
+	int                         frames, count;
+
+	if (crr->crr_Busy || crr->crr_Local) {
+		if (crr->crr_Busy) {
+			if (CheckIO((struct IORequest *)crr->crr_IOReq) == NULL)
+				return FALSE;
+
+			WaitIO((struct IORequest *)crr->crr_IOReq);
+			crr->crr_Busy = FALSE;
+		}
+
+		/* Throw it away if the layout changed while it was in flight */
+		if (pf->pf_Generation == cache->cc_Generation) {
+			ext = &cache->cc_Extent[pf->pf_Extent];
+
+			if (!crr->crr_Local && crr->crr_IOReq->io_Error == 0)
+				pcps->pcps_DiskCacheStored += write_disk_cache(dc, crr->crr_Addr, crr->crr_Frames, crr->crr_Buffer);
+
+			if (crr->crr_IOReq->io_Error != 0) {
+				/* Not worth retrying, the rest of the track plays from the drive */
+				truncate_cdda_cache(cache, ext);
+			} else if (store_cdda_cache(pcd, cache, ext, crr->crr_Buffer, crr->crr_Frames) < crr->crr_Frames) {
+				/* Out of memory, keep what fits */
+				truncate_cdda_cache(cache, NULL);
+			}
+
+			/* For the progress in the status */
+			Signal(ring->cr_PlayerTask, ring->cr_PlayerSig);
+		}
+
+		crr->crr_Local = FALSE;
+	}
+
+	if (pf->pf_Generation != cache->cc_Generation) {
+		pf->pf_Generation = cache->cc_Generation;
+		MEMORY_BARRIER();
+
+		layout_cdda_cache(cache, &pcd->pcd_TOC, pf->pf_Generation);
+
+		pf->pf_Pass    = 0;
+		pf->pf_Extent  = 0;
+		pf->pf_Stopped = FALSE;
+	}
+
+	if (!idle)
+		return FALSE;
+
+	ext = next_prefetch(cache, pf, &frames);
+	if (ext == NULL) {
+		/* Nothing will be read from the disc any more */
+		if (cache->cc_WholeDisc && cache->cc_Complete && cache->cc_NumExtents != 0 && !pf->pf_Stopped) {
+			if (pcd->pcd_Image == NULL)
+				stop_unit(crr);
+			pf->pf_Stopped = TRUE;
+		}
+		return FALSE;
+	}
+
+	crr->crr_Buffer = cdda_cache_target(cache, ext);
+	if (crr->crr_Buffer == NULL) {
+		/* Packed a block at a time, so only the end of an extent can be
+		 * a partial one */
+		crr->crr_Buffer = pf->pf_Buffer;
+
+		if (maxframes > pf->pf_BufFrames)
+			maxframes = pf->pf_BufFrames;
+
+		maxframes -= maxframes % CACHE_BLOCK_FRAMES;
+	}
+
+	if (frames > maxframes)
+		frames = maxframes;
+
+	addr = ext->ce_Addr + ext->ce_Done;
+
+	/* Handed over as if it had been read, the next call stores it */
+	count = read_local(pcd, dc, crr, addr, frames, FALSE);
+	if (count < frames && crr->crr_Buffer == pf->pf_Buffer)
+		count -= count % CACHE_BLOCK_FRAMES;
+
+	if (count > 0) {
+		crr->crr_Frames = count;
+
+		if (dc != NULL)
+			pcps->pcps_DiskCacheHits += count;
+		return TRUE;
+	}
+
+	crr->crr_Local = FALSE;
+
+	count = disk_cache_miss(dc, addr, frames);
+	if (count < frames && crr->crr_Buffer == pf->pf_Buffer)
+		count -= count % CACHE_BLOCK_FRAMES;
+
+	if (count > 0)
+		frames = count;
+
+	send_read_cd(pcd, crr, addr, frames);
+	return FALSE;
+}
+
+/* Frames of the current range that are published from pos onwards */
+ULONG cdda_ring_fill(const struct CDDARing *ring, ULONG pos) {
+	const struct CDDARingSlot *slot;
+	ULONG                      generation = ring->cr_Generation;
+	ULONG                      fill = 0;
+
+	for (; pos != ring->cr_Head; pos++) {
+		slot = &ring->cr_Slot[pos % ring->cr_NumSlots];
+
+		if (slot->rs_Generation == generation)
+			fill += slot->rs_Frames;
+	}
+
+	return fill;
+}
+
+struct CDDARing *alloc_cdda_ring(struct PlayCDDAData *pcd) {
+	struct PlayCDDAPlayerData *pcpd = &pcd->pcd_PlayerData;
+	struct CDDARing           *ring;
+	ULONG                      budget;
+	int                        numslots, slotframes;
+	int                        i;
+
+	numslots = pcpd->pcpd_NumCDDABufs;
+	if (numslots < 2)
+		numslots = 2;
+	else if (numslots > MAX_CDDA_BUFS)
+		numslots = MAX_CDDA_BUFS;
+
+	/* Size the buffers to fit the memory budget */
+	budget = pcpd->pcpd_ReadBudget;
+	if (budget == 0)
+		budget = CDDA_READ_BUDGET;
+
+	slotframes = budget / (numslots * CDDA_FRAME_SIZE);
+	if (slotframes < CDDA_MIN_FRAMES) {
+		numslots = budget / (CDDA_MIN_FRAMES * CDDA_FRAME_SIZE);
+		if (numslots < 2)
+			numslots = 2;
+
+		slotframes = CDDA_MIN_FRAMES;
+	} else if (slotframes > CDDA_MAX_FRAMES) {
+		slotframes = CDDA_MAX_FRAMES;
+	}
+
+	ring = alloc_shared_mem(sizeof(*ring));
+	if (ring == NULL)
+		return NULL;
+
+	memset(ring, 0, sizeof(*ring));
+
+	ring->cr_NumSlots   = numslots;
+	ring->cr_SlotFrames = slotframes;
+	ring->cr_Failed     = ~0;
+
+	for (i = 0; i < numslots; i++) {
+		ring->cr_Slot[i].rs_Buffer = alloc_shared_mem(slotframes * CDDA_FRAME_SIZE);
+		if (ring->cr_Slot[i].rs_Buffer == NULL) {
+			free_cdda_ring(ring);
+			return NULL;
+		}
+
+		ring->cr_Slot[i].rs_Data       = ring->cr_Slot[i].rs_Buffer;
+		ring->cr_Slot[i].rs_Generation = ~0;
+	}
+
+	/* Playback works without it */
+	ring->cr_Cache = alloc_cdda_cache(pcd);
+
+	return ring;
+}
+
+void free_cdda_ring(struct CDDARing *ring) {
+	int i;
+
+	if (ring != NULL) {
+		for (i = 0; i < ring->cr_NumSlots; i++) {
+			if (ring->cr_Slot[i].rs_Buffer != NULL)
+				free_shared_mem(ring->cr_Slot[i].rs_Buffer, ring->cr_SlotFrames * CDDA_FRAME_SIZE);
+		}
+
+		free_cdda_cache(ring->cr_Cache);
+
+		free_shared_mem(ring, sizeof(*ring));
+	}
+}
+
+static int reader_proc_entry(void) {
+	struct Process             *me;
+	struct MsgPort             *myport;
+	struct PlayCDDAData        *pcd;
+	struct PlayCDDAMsg         *pcm;
+	struct PlayCDDAPlayerStats *pcps;
+	struct CDDARing            *ring;
+	struct MsgPort             *cdport = NULL;
+	struct CDDAReadQueue        rq;
+	struct CDDAReadCtl         *ctl = &rq.rq_Ctl;
+	struct CDDAReadReq         *crr;
+	struct CDDARingSlot        *slot;
+	struct SpeedGovernor        sg;
+	struct Prefetcher           pf;
+	struct PlayCDDATOC          toc;
+	struct DiskCache           *dc = NULL;
+	LONG                        read_addr = 0, end_addr = 0;
+	LONG                        run_start, run_end = 0;
+	ULONG                       generation, disc_generation;
+	ULONG                       features;
+	ULONG                       sigmask;
+	BYTE                        signal;
+	int                         i;
+
+	me     = (struct Process *)FindTask(NULL);
+	myport = &me->pr_MsgPort;
+
+	/* No "Please insert volume" requesters for the sector cache directory */
+	me->pr_WindowPtr = (APTR)~0;
+
+	WaitPort(myport);
+	pcm = (struct PlayCDDAMsg *)GetMsg(myport);
+
+	pcd  = pcm->pcm_GlobalData;
+	ring = (struct CDDARing *)pcm->pcm_Arg1;
+	pcps = &pcd->pcd_PlayerData.pcpd_Stats;
+
+	memset(&rq, 0, sizeof(rq));
+	memset(&sg, 0, sizeof(sg));
+	sg.sg_Speed = SPEED_UNSET;
+	memset(&pf, 0, sizeof(pf));
+
+	rq.rq_NumBufs   = ring->cr_NumSlots;
+	rq.rq_BufFrames = ring->cr_SlotFrames;
+
+	ctl->rc_MinFrames = CDDA_MIN_FRAMES;
+	ctl->rc_MaxFrames = rq.rq_BufFrames;
+	ctl->rc_Frames    = CDDA_START_FRAMES;
+	if (ctl->rc_Frames > ctl->rc_MaxFrames || pcd->pcd_Image != NULL)
+		ctl->rc_Frames = ctl->rc_MaxFrames;
+
+	/* Nothing to set the speed of, or a drive that said at probe time that
+	 * it has no SET CD SPEED */
+	features = pcd->pcd_CurrentDrive->cdd_Caps.cap_Features;
+	sg.sg_Disabled = (pcd->pcd_Image != NULL) || ((features & CDF_KNOWN) && !(features & CDF_SETSPEED));
+
+	signal = AllocSignal(-1);
+	if (signal == -1)
+		goto cleanup;
+
+	cdport = create_msgport();
+	if (cdport == NULL)
+		goto cleanup;
+
+	/* One cloned request per ring slot, so that all reads can be queued at once */
+	for (i = 0; i < rq.rq_NumBufs; i++) {
+		crr = &rq.rq_Req[i];
+
+		crr->crr_IOReq = (struct IOStdReq *)copy_iorequest((struct IORequest *)pcd->pcd_CDReq);
+		if (crr->crr_IOReq == NULL)
+			goto cleanup;
+
+		crr->crr_IOReq->io_Message.mn_ReplyPort = cdport;
+		crr->crr_Buffer = ring->cr_Slot[i].rs_Buffer;
+	}
+
+	sg.sg_IOReq = (struct IOStdReq *)copy_iorequest((struct IORequest *)pcd->pcd_CDReq);
+	if (sg.sg_IOReq == NULL)
+		goto cleanup;
+
+	sg.sg_IOReq->io_Message.mn_ReplyPort = cdport;
+
+	if (ring->cr_Cache != NULL) {
+		pf.pf_Req.crr_IOReq = (struct IOStdReq *)copy_iorequest((struct IORequest *)pcd->pcd_CDReq);
+		if (pf.pf_Req.crr_IOReq == NULL)
+			goto cleanup;
+
+		pf.pf_Req.crr_IOReq->io_Message.mn_ReplyPort = cdport;
+
+		if (ring->cr_Cache->cc_Packed) {
+			pf.pf_BufFrames = rq.rq_BufFrames - (rq.rq_BufFrames % CACHE_BLOCK_FRAMES);
+
+			pf.pf_Buffer = alloc_shared_mem(pf.pf_BufFrames * CDDA_FRAME_SIZE);
+			if (pf.pf_Buffer == NULL)
+				goto cleanup;
+		}
+	}
+
+	ring->cr_ReaderSig  = (ULONG)1 << signal;
+	ring->cr_ReaderTask = &me->pr_Task;
+
+	pcm->pcm_Result = TRUE;
+	ReplyMsg(&pcm->pcm_Msg);
+	pcm = NULL;
+
+	sigmask = ring->cr_ReaderSig | ((ULONG)1 << cdport->mp_SigBit);
+
+	generation      = ring->cr_Generation;
+	disc_generation = ring->cr_DiscGeneration;
+
+	while (!ring->cr_Quit) {
+		if (ring->cr_DiscGeneration != disc_generation) {
+			/* Switch to the sector cache file of the new disc */
+			disc_generation = ring->cr_DiscGeneration;
+			MEMORY_BARRIER();
+
+			close_disk_cache(dc);
+			dc = NULL;
+
+			/* Images are already on disk */
+			if (pcd->pcd_Image == NULL)
+				dc = open_disk_cache(pcd, &pcd->pcd_TOC);
+		}
+
+		if (ring->cr_Generation != generation) {
+			/* The player wants a new range, drop everything in flight */
+			flush_read_queue(&rq, 0);
+
+			generation = ring->cr_Generation;
+			MEMORY_BARRIER();
+			read_addr = ring->cr_StartAddr;
+			end_addr  = ring->cr_EndAddr;
+			run_end   = read_addr;
+
+			/* Our own copy, the main process rereads it on disc changes */
+			toc = pcd->pcd_TOC;
+
+			rq.rq_Errors = 0;
+		}
+
+		poll_read_queue(pcd, &rq);
+
+		/* Publish finished reads, in the order they were sent */
+		while (rq.rq_Queued > 0) {
+			crr = &rq.rq_Req[rq.rq_Head];
+
+			if (!crr->crr_Timed)
+				break;
+
+			if (crr->crr_Busy) {
+				WaitIO((struct IORequest *)crr->crr_IOReq);
+				crr->crr_Busy = FALSE;
+			}
+
+			if (crr->crr_IOReq->io_Error != 0) {
+				pcps->pcps_ReadErrors++;
+
+				/* Drop the reads queued behind the failed one and retry from
+				 * there with the smaller transfer size. Skip the sectors if
+				 * the size can't get any smaller. */
+				flush_read_queue(&rq, 0);
+
+				read_addr = crr->crr_Addr;
+				if (crr->crr_Frames <= ctl->rc_MinFrames)
+					read_addr += crr->crr_Frames;
+
+				if (++rq.rq_Errors >= MAX_READ_ERRORS) {
+					ring->cr_Failed = generation;
+					read_addr = end_addr;
+
+					Signal(ring->cr_PlayerTask, ring->cr_PlayerSig);
+				}
+				break;
+			}
+
+			rq.rq_Errors = 0;
+
+			/* Stored before the slot is handed over, as the player may
+			 * convert it in place. Reads from before a disc change might
+			 * be from the old disc. */
+			if (crr->crr_Local) {
+				if (dc != NULL)
+					pcps->pcps_DiskCacheHits += crr->crr_Frames;
+			} else if (crr->crr_Disc == disc_generation)
+				pcps->pcps_DiskCacheStored += write_disk_cache(dc, crr->crr_Addr, crr->crr_Frames, crr->crr_Buffer);
+
+			slot = &ring->cr_Slot[rq.rq_Head];
+
+			slot->rs_Data       = crr->crr_Data;
+			slot->rs_Addr       = crr->crr_Addr;
+			slot->rs_Frames     = crr->crr_Frames;
+			slot->rs_Generation = generation;
+
+			MEMORY_BARRIER();
+			ring->cr_Head++;
+
+			rq.rq_Head = (rq.rq_Head + 1) % rq.rq_NumBufs;
+			rq.rq_Queued--;
+
+			Signal(ring->cr_PlayerTask, ring->cr_PlayerSig);
+
+			pcps->pcps_FramesRead += crr->crr_Frames;
+			pcps->pcps_ReadFrames  = ctl->rc_Frames;
+			pcps->pcps_ReadLatency = ctl->rc_Latency;
+			pcps->pcps_DriveRate   = ctl->rc_Rate;
+
+			update_speed_governor(&sg, pcd->pcd_PlayerData.pcpd_SpeedMode,
+				cdda_ring_fill(ring, ring->cr_Tail), rq.rq_NumBufs * ctl->rc_Frames);
+
+			pcps->pcps_DriveSpeed = SPEED_TO_KBPS(sg.sg_Speed);
+		}
+
+		/* Keep every free slot busy with a read */
+		while ((ring->cr_Head - ring->cr_Tail) + rq.rq_Queued < rq.rq_NumBufs && read_addr < end_addr) {
+			int frames;
+
+			if (read_addr >= run_end) {
+				/* Carry on into the next audio track, past any data tracks,
+				 * so that the player never sees a gap */
+				if (toc.toc_NumTracks == 0) {
+					run_end = end_addr;
+				} else if (get_audio_run(&toc, read_addr, &run_start, &run_end) && run_start < end_addr) {
+					read_addr = run_start;
+				} else {
+					read_addr = end_addr;
+					break;
+				}
+
+				if (run_end > end_addr)
+					run_end = end_addr;
+			}
+
+			frames = ctl->rc_Frames;
+			if (frames > (run_end - read_addr))
+				frames = run_end - read_addr;
+
+			crr = &rq.rq_Req[(rq.rq_Head + rq.rq_Queued) % rq.rq_NumBufs];
+
+			/* Go to the drive only for what isn't in the image or the sector
+			 * cache file. A local read is published in turn, like one that
+			 * was sent. */
+			if (read_local(pcd, dc, crr, read_addr, frames, TRUE) > 0) {
+				frames = crr->crr_Frames;
+			} else {
+				frames = disk_cache_miss(dc, read_addr, frames);
+
+				send_read_cd(pcd, crr, read_addr, frames);
+				crr->crr_Disc = disc_generation;
+			}
+
+			read_addr += frames;
+			rq.rq_Queued++;
+		}
+
+		/* Only touch the cache while the drive would otherwise be idle, so
+		 * that playback never has to wait for a prefetch to finish */
+		if (ring->cr_Cache != NULL) {
+			BOOL idle = (rq.rq_Queued == 0 && read_addr >= end_addr);
+
+			/* Get the whole disc cached at full speed */
+			if (idle && ring->cr_Cache->cc_WholeDisc && pf.pf_Pass < 2 &&
+				sg.sg_Speed != 0 && !sg.sg_Busy && !sg.sg_Disabled)
+			{
+				send_set_cd_speed(&sg, 0, FALSE);
+			}
+
+			/* Served from the file, see if there's more */
+			if (update_prefetch(pcd, ring, &pf, dc, idle, ctl->rc_Frames))
+				continue;
+		}
+
+		/* Local reads don't signal, and neither does a failed read that
+		 * left a free slot to retry in. With every slot taken, the player
+		 * signals once it has released one. */
+		if ((rq.rq_Queued > 0 && rq.rq_Req[rq.rq_Head].crr_Local) ||
+			((ring->cr_Head - ring->cr_Tail) + rq.rq_Queued < rq.rq_NumBufs && read_addr < end_addr))
+		{
+			continue;
+		}
+
+		Wait(sigmask);
+	}
+
+cleanup:
+	if (pcm != NULL) {
+		/* Startup failed */
+		pcm->pcm_Result = FALSE;
+		ReplyMsg(&pcm->pcm_Msg);
+	}
+
+	for (i = 0; i < rq.rq_NumBufs; i++) {
+		crr = &rq.rq_Req[i];
+
+		abort_read_cd(crr);
+
+		delete_iorequest_copy((struct IORequest *)crr->crr_IOReq);
+	}
+
+	if (pf.pf_Req.crr_IOReq != NULL) {
+		abort_read_cd(&pf.pf_Req);
+
+		delete_iorequest_copy((struct IORequest *)pf.pf_Req.crr_IOReq);
+	}
+
+	if (pf.pf_Buffer != NULL)
+		free_shared_mem(pf.pf_Buffer, pf.pf_BufFrames * CDDA_FRAME_SIZE);
+
+	if (sg.sg_IOReq != NULL) {
+		finish_set_cd_speed(&sg);
+
+		/* Leave the drive at full speed for other programs */
+		if (sg.sg_Speed > 0 && !sg.sg_Disabled)
+			send_set_cd_speed(&sg, 0, TRUE);
+
+		delete_iorequest_copy((struct IORequest *)sg.sg_IOReq);
+	}
+
+	close_disk_cache(dc);
+
+	delete_msgport(cdport);
+
+	FreeSignal(signal);
+
+	if (ring->cr_ReaderTask != NULL) {
+		/* We're gone once the player sees cr_ReaderTask cleared. Our exit
+		 * breaks the Forbid(), so the player can't free the ring under us. */
+		Forbid();
+		ring->cr_ReaderTask = NULL;
+		Signal(ring->cr_PlayerTask, ring->cr_PlayerSig);
+	}
+
+	return RETURN_OK;
+}
+
+BOOL start_reader_proc(struct PlayCDDAData *pcd, struct CDDARing *ring) {
+	struct MsgPort     *reply_port;
+	struct Process     *proc;
+	struct PlayCDDAMsg  pcm;
+	BOOL                result = FALSE;
+
+	reply_port = create_msgport();
+	if (reply_port == NULL)
+		return FALSE;
+
+	memset(&pcm, 0, sizeof(pcm));
+
+	pcm.pcm_Msg.mn_Node.ln_Type = NT_MESSAGE;
+	pcm.pcm_Msg.mn_ReplyPort    = reply_port;
+	pcm.pcm_Msg.mn_Length       = sizeof(pcm);
+
+	pcm.pcm_GlobalData = pcd;
+	pcm.pcm_Command    = PCC_STARTUP;
+	pcm.pcm_Arg1       = (pcm_arg_t)ring;
+
+	proc = CreateNewProcTags(
+		NP_Name,        "PlayCDDA Reader Process",
+		NP_Entry,       &reader_proc_entry,
+		NP_StackSize,   8192,
+		NP_Priority,    READER_PROC_PRI,
+		NP_CurrentDir,  0,
+		NP_Path,        0,
+		NP_CopyVars,    FALSE,
+		NP_Input,       0,
+		NP_Output,      0,
+		NP_Error,       0,
+		NP_CloseInput,  FALSE,
+		NP_CloseOutput, FALSE,
+		NP_CloseError,  FALSE,
+		TAG_END);
+	if (proc != NULL) {
+		/* The reader can't go away before it has replied */
+		PutMsg(&proc->pr_MsgPort, &pcm.pcm_Msg);
+
+		WaitPort(reply_port);
+		GetMsg(reply_port);
+
+		result = pcm.pcm_Result;
+	}
+
+	delete_msgport(reply_port);
+
+	return result;
+}
+
+/* Must be called from the task that owns cr_PlayerSig */
+void stop_reader_proc(struct CDDARing *ring) {
+	ring->cr_Quit = TRUE;
+
+	Forbid();
+
+	if (ring->cr_ReaderTask != NULL)
+		Signal(ring->cr_ReaderTask, ring->cr_ReaderSig);
+
+	Permit();
+
+	while (ring->cr_ReaderTask != NULL)
+		Wait(ring->cr_PlayerSig);
+}
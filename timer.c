@@ -0,0 +1,144 @@
+/*
+ * PlayCDDA - AmigaOS/AROS native CD audio player
+ * Copyright (C) 2017 Fredrik Wikstrom <fredrik@a500.org>
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS `AS IS'
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "playcdda.h"
+
+BOOL open_timer(struct PlayCDDAData *pcd) {
+	struct EClockVal ev;
+
+	pcd->pcd_TimerPort = create_msgport();
+	if (pcd->pcd_TimerPort == NULL)
+		return FALSE;
+
+	pcd->pcd_TimerReq = (struct timerequest *)create_iorequest(pcd->pcd_TimerPort, sizeof(struct timerequest));
+	if (pcd->pcd_TimerReq == NULL)
+		return FALSE;
+
+	if (OpenDevice((CONST_STRPTR)TIMERNAME, UNIT_ECLOCK, (struct IORequest *)pcd->pcd_TimerReq, 0) != 0) {
+		pcd->pcd_TimerReq->tr_node.io_Device = NULL;
+		return FALSE;
+	}
+
+	TimerBase = pcd->pcd_TimerReq->tr_node.io_Device;
+
+#ifdef __amigaos4__
+	ITimer = (struct TimerIFace *)GetInterface((struct Library *)TimerBase, "main", 1, NULL);
+	if (ITimer == NULL)
+		return FALSE;
+#endif
+
+	pcd->pcd_EClockFreq = ReadEClock(&ev);
+
+	pcd->pcd_AlarmReq = (struct timerequest *)copy_iorequest((struct IORequest *)pcd->pcd_TimerReq);
+	if (pcd->pcd_AlarmReq == NULL)
+		return FALSE;
+
+	return TRUE;
+}
+
+void close_timer(struct PlayCDDAData *pcd) {
+	if (pcd->pcd_AlarmReq != NULL) {
+		stop_alarm(pcd);
+
+		delete_iorequest_copy((struct IORequest *)pcd->pcd_AlarmReq);
+	}
+
+#ifdef __amigaos4__
+	DropInterface((struct Interface *)ITimer);
+#endif
+
+	if (pcd->pcd_TimerReq != NULL) {
+		if (pcd->pcd_TimerReq->tr_node.io_Device != NULL)
+			CloseDevice((struct IORequest *)pcd->pcd_TimerReq);
+
+		delete_iorequest((struct IORequest *)pcd->pcd_TimerReq);
+	}
+
+	delete_msgport(pcd->pcd_TimerPort);
+}
+
+/* Microseconds from an arbitrary start point. Wraps after about 71 minutes,
+ * so only use it for measuring intervals shorter than that. */
+ULONG get_time_us(struct PlayCDDAData *pcd) {
+	struct EClockVal ev;
+	UQUAD            ticks;
+	ULONG            freq;
+
+	freq  = ReadEClock(&ev);
+	ticks = ((UQUAD)ev.ev_hi << 32) | ev.ev_lo;
+
+	return (ULONG)((ticks / freq) * 1000000 + ((ticks % freq) * 1000000) / freq);
+}
+
+/* Signals pcd_TimerPort after ms milliseconds, starting over if it's
+ * already running. Only for the main process. */
+void set_alarm(struct PlayCDDAData *pcd, ULONG ms) {
+	struct timerequest *tr = pcd->pcd_AlarmReq;
+	UQUAD               ticks;
+
+	stop_alarm(pcd);
+
+	/* E-clock ticks for UNIT_ECLOCK */
+	ticks = ((UQUAD)ms * pcd->pcd_EClockFreq) / 1000;
+
+	tr->tr_node.io_Command = TR_ADDREQUEST;
+	tr->tr_time.tv_secs    = (ULONG)(ticks >> 32);
+	tr->tr_time.tv_micro   = (ULONG)ticks;
+
+	SendIO((struct IORequest *)tr);
+	pcd->pcd_AlarmBusy = TRUE;
+}
+
+void stop_alarm(struct PlayCDDAData *pcd) {
+	struct IORequest *ioreq = (struct IORequest *)pcd->pcd_AlarmReq;
+
+	if (pcd->pcd_AlarmBusy) {
+		if (CheckIO(ioreq) == NULL)
+			AbortIO(ioreq);
+
+		WaitIO(ioreq);
+		pcd->pcd_AlarmBusy = FALSE;
+	}
+}
+
+/* TRUE once when the alarm has gone off */
+BOOL check_alarm(struct PlayCDDAData *pcd) {
+	struct IORequest *ioreq = (struct IORequest *)pcd->pcd_AlarmReq;
+
+	if (!pcd->pcd_AlarmBusy || CheckIO(ioreq) == NULL)
+		return FALSE;
+
+	WaitIO(ioreq);
+	pcd->pcd_AlarmBusy = FALSE;
+
+	return TRUE;
+}
+
+ULONG get_alarm_signal(const struct PlayCDDAData *pcd) {
+	return (ULONG)1 << pcd->pcd_TimerPort->mp_SigBit;
+}